@@ -0,0 +1,303 @@
+#ifndef __BATCHED_DATTORRO_REVERB_HPP__
+#define __BATCHED_DATTORRO_REVERB_HPP__
+
+#include "OpenWareLibrary.h"
+#include "DattorroStereoReverb.hpp"
+
+/**
+ * 4 or 8 independent Dattorro reverbs processed side by side.
+ *
+ * Every lane is a complete stereo reverb with the same topology and delay
+ * lengths as DattorroStereoReverb<> (no smearing, no processors in the
+ * loop), but with its own delay memory, LFO phase and parameters. Lane n
+ * reads and writes channels 2n and 2n+1 of the AudioBuffer.
+ *
+ * Delay memory is interleaved by lane, so that every tap of the loop reads
+ * or writes lanes consecutive floats and all lanes share a single write
+ * index. Every step of the loop is then a plain loop over lanes that the
+ * compiler maps to SIMD registers. Only the two modulated taps need a
+ * gather, since their read positions differ per lane.
+ *
+ * The LFOs are rotating phasors instead of sinf calls, so they vectorize
+ * too. They are renormalized once per block.
+ **/
+template <size_t lanes = 4>
+class BatchedDattorroReverb : public MultiSignalProcessor {
+private:
+    static_assert(lanes == 4 || lanes == 8, "Batched reverb supports 4 or 8 lanes");
+    static constexpr size_t num_delays = 14;
+
+    /**
+     * Fixed length delay line holding all lanes, interleaved
+     */
+    struct LaneDelay {
+        float* data;
+        size_t size;
+        size_t write_index;
+
+        inline float* tap() {
+            return data + write_index * lanes;
+        }
+        inline void advance() {
+            if (++write_index == size)
+                write_index = 0;
+        }
+        /**
+         * @param index read position, must be less than twice the size
+         */
+        inline float readAt(size_t lane, float index) {
+            size_t idx = (size_t)index;
+            float frac = index - idx;
+            idx = idx < size ? idx : idx - size;
+            size_t next = idx + 1 < size ? idx + 1 : 0;
+            float low = data[idx * lanes + lane];
+            float high = data[next * lanes + lane];
+            return low + (high - low) * frac;
+        }
+    };
+
+public:
+    BatchedDattorroReverb(float* memory, const size_t* delay_lengths, float sr)
+        : memory(memory) {
+        size_t offset = 0;
+        for (size_t i = 0; i < num_delays; i++) {
+            delays[i].data = memory + offset;
+            delays[i].size = delay_lengths[i];
+            delays[i].write_index = 0;
+            offset += delay_lengths[i] * lanes;
+        }
+        memory_size = offset;
+        lfo_increment1 = 2 * M_PI * 0.5f / sr;
+        lfo_increment2 = 2 * M_PI * 0.3f / sr;
+        for (size_t lane = 0; lane < lanes; lane++) {
+            amount[lane] = 0;
+            decay[lane] = 0;
+            diffusion[lane] = 0;
+            damping[lane] = 0;
+            lfo_offset1[lane] = 0;
+            lfo_offset2[lane] = 0;
+            lfo_amount1[lane] = 0;
+            lfo_amount2[lane] = 0;
+            setModulationPhase(lane, 0, 0);
+        }
+        clear();
+    }
+    void process(AudioBuffer& input, AudioBuffer& output) override {
+        size_t size = input.getSize();
+        float* in[lanes * 2];
+        float* out[lanes * 2];
+        for (size_t ch = 0; ch < lanes * 2; ch++) {
+            in[ch] = input.getSamples(ch).getData();
+            out[ch] = output.getSamples(ch).getData();
+        }
+
+        // Lane parameters are read once per block, like the scalar reverb
+        float kap[lanes], klp[lanes], krt[lanes], wet[lanes];
+        float read_offset1[lanes], read_offset2[lanes];
+        for (size_t lane = 0; lane < lanes; lane++) {
+            kap[lane] = diffusion[lane];
+            klp[lane] = damping[lane];
+            krt[lane] = decay[lane];
+            wet[lane] = amount[lane];
+            read_offset1[lane] = (delays[10].write_index + delays[10].size -
+                lfo_offset1[lane]) % delays[10].size;
+            read_offset2[lane] = (delays[13].write_index + delays[13].size -
+                lfo_offset2[lane]) % delays[13].size;
+        }
+        const float cos1 = cosf(lfo_increment1), sin1 = sinf(lfo_increment1);
+        const float cos2 = cosf(lfo_increment2), sin2 = sinf(lfo_increment2);
+
+        float left[lanes], right[lanes], acc[lanes], mod[lanes];
+        for (size_t n = 0; n < size; n++) {
+            for (size_t lane = 0; lane < lanes; lane++) {
+                left[lane] = in[lane * 2][n];
+                right[lane] = in[lane * 2 + 1][n];
+            }
+
+            // Left channel
+            for (size_t lane = 0; lane < lanes; lane++) {
+                acc[lane] = left[lane];
+            }
+            for (size_t i = 0; i < 4; i++) {
+                processAPF(delays[i], acc, kap, 1);
+            }
+            advanceLFO(lfo_sin2, lfo_cos2, cos2, sin2, lfo_amount2, mod);
+            for (size_t lane = 0; lane < lanes; lane++) {
+                acc[lane] += delays[13].readAt(lane, mod[lane] + read_offset2[lane]) *
+                    krt[lane];
+                read_offset2[lane] += 1;
+                if (read_offset2[lane] >= delays[13].size)
+                    read_offset2[lane] -= delays[13].size;
+            }
+            processFilter(lp1_state, acc, klp);
+            processAPF(delays[8], acc, kap, -1);
+            processAPF(delays[9], acc, kap, 1);
+            processFilter(hp1_state, acc, klp);
+            write(delays[10], acc);
+            for (size_t lane = 0; lane < lanes; lane++) {
+                out[lane * 2][n] = left[lane] + (acc[lane] - left[lane]) * wet[lane];
+            }
+
+            // Right channel
+            for (size_t lane = 0; lane < lanes; lane++) {
+                acc[lane] = right[lane];
+            }
+            for (size_t i = 4; i < 8; i++) {
+                processAPF(delays[i], acc, kap, 1);
+            }
+            advanceLFO(lfo_sin1, lfo_cos1, cos1, sin1, lfo_amount1, mod);
+            for (size_t lane = 0; lane < lanes; lane++) {
+                acc[lane] += delays[10].readAt(lane, mod[lane] + read_offset1[lane]) *
+                    krt[lane];
+                read_offset1[lane] += 1;
+                if (read_offset1[lane] >= delays[10].size)
+                    read_offset1[lane] -= delays[10].size;
+            }
+            processFilter(lp2_state, acc, klp);
+            processAPF(delays[11], acc, kap, 1);
+            processAPF(delays[12], acc, kap, -1);
+            processFilter(hp2_state, acc, klp);
+            write(delays[13], acc);
+            for (size_t lane = 0; lane < lanes; lane++) {
+                out[lane * 2 + 1][n] = right[lane] + (acc[lane] - right[lane]) * wet[lane];
+            }
+        }
+        normalizeLFO(lfo_sin1, lfo_cos1);
+        normalizeLFO(lfo_sin2, lfo_cos2);
+    }
+
+    void setAmount(size_t lane, float amount) {
+        this->amount[lane] = amount;
+    }
+
+    void setDecay(size_t lane, float decay) {
+        this->decay[lane] = decay;
+    }
+
+    void setDiffusion(size_t lane, float diffusion) {
+        this->diffusion[lane] = diffusion;
+    }
+
+    void setDamping(size_t lane, float damping) {
+        this->damping[lane] = damping;
+    }
+
+    void setModulation(size_t lane, size_t offset1, size_t amount1,
+        size_t offset2, size_t amount2) {
+        lfo_offset1[lane] = offset1;
+        lfo_amount1[lane] = amount1 / 2;
+        lfo_offset2[lane] = offset2;
+        lfo_amount2[lane] = amount2 / 2;
+    }
+
+    /**
+     * Set LFO phases of a lane, in radians
+     */
+    void setModulationPhase(size_t lane, float phase1, float phase2) {
+        lfo_sin1[lane] = sinf(phase1);
+        lfo_cos1[lane] = cosf(phase1);
+        lfo_sin2[lane] = sinf(phase2);
+        lfo_cos2[lane] = cosf(phase2);
+    }
+
+    void clear() {
+        memset(memory, 0, memory_size * sizeof(float));
+        for (size_t lane = 0; lane < lanes; lane++) {
+            lp1_state[lane] = 0;
+            lp2_state[lane] = 0;
+            hp1_state[lane] = 0;
+            hp2_state[lane] = 0;
+        }
+    }
+
+    static constexpr size_t getLanes() {
+        return lanes;
+    }
+
+    static BatchedDattorroReverb* create(size_t /* block_size */, float sr,
+        const size_t* delay_lengths) {
+        size_t total = 0;
+        for (size_t i = 0; i < num_delays; i++) {
+            total += delay_lengths[i];
+        }
+        return new BatchedDattorroReverb(new float[total * lanes], delay_lengths, sr);
+    }
+
+    static void destroy(BatchedDattorroReverb* reverb) {
+        delete[] reverb->memory;
+        delete reverb;
+    }
+
+protected:
+    float* memory;
+    size_t memory_size;
+    LaneDelay delays[num_delays];
+    float amount[lanes];
+    float decay[lanes];
+    float diffusion[lanes];
+    float damping[lanes];
+    float lp1_state[lanes], lp2_state[lanes];
+    float hp1_state[lanes], hp2_state[lanes];
+    size_t lfo_offset1[lanes], lfo_offset2[lanes];
+    float lfo_amount1[lanes], lfo_amount2[lanes];
+    float lfo_sin1[lanes], lfo_cos1[lanes];
+    float lfo_sin2[lanes], lfo_cos2[lanes];
+    float lfo_increment1, lfo_increment2;
+
+    /**
+     * Same one pole filter as ReverbPrimitives, used for both LP and HP
+     */
+    static inline void processFilter(float* state, float* value, const float* coeff) {
+        for (size_t lane = 0; lane < lanes; lane++) {
+            state[lane] += coeff[lane] * (value[lane] - state[lane]);
+            value[lane] = state[lane];
+        }
+    }
+
+    /**
+     * @param sign -1 for the APFs that run with negated diffusion
+     */
+    static inline void processAPF(LaneDelay& delay, float* acc, const float* kap,
+        float sign) {
+        float* tap = delay.tap();
+        for (size_t lane = 0; lane < lanes; lane++) {
+            float k = kap[lane] * sign;
+            float sample = tap[lane];
+            acc[lane] += sample * k;
+            tap[lane] = acc[lane];
+            acc[lane] = acc[lane] * -k + sample;
+        }
+        delay.advance();
+    }
+
+    static inline void write(LaneDelay& delay, const float* value) {
+        float* tap = delay.tap();
+        for (size_t lane = 0; lane < lanes; lane++) {
+            tap[lane] = value[lane];
+        }
+        delay.advance();
+    }
+
+    /**
+     * Output (sin + 1) * amount for every lane and rotate the phasors
+     */
+    static inline void advanceLFO(float* s, float* c, float cos_inc, float sin_inc,
+        const float* depth, float* mod) {
+        for (size_t lane = 0; lane < lanes; lane++) {
+            mod[lane] = (s[lane] + 1) * depth[lane];
+            float sn = s[lane] * cos_inc + c[lane] * sin_inc;
+            c[lane] = c[lane] * cos_inc - s[lane] * sin_inc;
+            s[lane] = sn;
+        }
+    }
+
+    static inline void normalizeLFO(float* s, float* c) {
+        for (size_t lane = 0; lane < lanes; lane++) {
+            float gain = 1.0f / sqrtf(s[lane] * s[lane] + c[lane] * c[lane]);
+            s[lane] *= gain;
+            c[lane] *= gain;
+        }
+    }
+};
+
+#endif
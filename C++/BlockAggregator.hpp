@@ -0,0 +1,95 @@
+#ifndef __BLOCK_AGGREGATOR_HPP__
+#define __BLOCK_AGGREGATOR_HPP__
+
+#include "OpenWareLibrary.h"
+
+/**
+ * Runs processing on a larger internal block than the host block size.
+ *
+ * Host blocks are collected until an internal block of factor host blocks
+ * is full, which is then processed in one go. Output comes from the
+ * previous internal block, double buffered, and is delayed by
+ * (factor - 1) host blocks: the last host block of an internal block is
+ * played back right after processing.
+ *
+ * This trades latency for less per-call overhead, but the whole internal
+ * block is processed during a single host callback, so that callback has
+ * to fit the cost of factor host blocks. With a factor of 1 blocks are
+ * passed straight through.
+ **/
+class BlockAggregator {
+public:
+    BlockAggregator(AudioBuffer* input_block, AudioBuffer* output_block,
+        size_t host_block_size, size_t factor)
+        : input_block(input_block)
+        , output_block(output_block)
+        , host_block_size(host_block_size)
+        , factor(factor)
+        , slot(0) {
+        clear();
+    }
+    /**
+     * Process one host block in place
+     * @param process callable taking the AudioBuffer of an internal block
+     */
+    template <typename Processor>
+    void process(AudioBuffer& buffer, Processor process) {
+        if (factor == 1) {
+            process(buffer);
+            return;
+        }
+        size_t size = min(buffer.getSize(), host_block_size);
+        size_t offset = slot * host_block_size;
+        for (size_t ch = 0; ch < 2; ch++) {
+            input_block->getSamples(ch).subArray(offset, size).copyFrom(
+                buffer.getSamples(ch).subArray(0, size));
+        }
+        if (++slot == factor) {
+            process(*input_block);
+            AudioBuffer* tmp = input_block;
+            input_block = output_block;
+            output_block = tmp;
+            slot = 0;
+        }
+        // Output runs one slot ahead of input: slot 0 of a new block goes
+        // out right after processing
+        offset = slot * host_block_size;
+        for (size_t ch = 0; ch < 2; ch++) {
+            buffer.getSamples(ch).subArray(0, size).copyFrom(
+                output_block->getSamples(ch).subArray(offset, size));
+        }
+    }
+    void clear() {
+        input_block->clear();
+        output_block->clear();
+        slot = 0;
+    }
+    /**
+     * @return added latency in samples
+     */
+    size_t getLatency() const {
+        return (factor - 1) * host_block_size;
+    }
+    size_t getInternalBlockSize() const {
+        return factor * host_block_size;
+    }
+    static BlockAggregator* create(size_t host_block_size, size_t factor) {
+        factor = max(factor, size_t(1));
+        return new BlockAggregator(AudioBuffer::create(2, host_block_size * factor),
+            AudioBuffer::create(2, host_block_size * factor), host_block_size, factor);
+    }
+    static void destroy(BlockAggregator* aggregator) {
+        AudioBuffer::destroy(aggregator->input_block);
+        AudioBuffer::destroy(aggregator->output_block);
+        delete aggregator;
+    }
+
+private:
+    AudioBuffer* input_block;
+    AudioBuffer* output_block;
+    size_t host_block_size;
+    size_t factor;
+    size_t slot;
+};
+
+#endif
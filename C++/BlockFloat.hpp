@@ -0,0 +1,55 @@
+#ifndef __BLOCK_FLOAT_HPP__
+#define __BLOCK_FLOAT_HPP__
+
+#include "basicmaths.h"
+
+/**
+ * Block floating point: 16 bit mantissas that share one scale factor per
+ * block, scaled so the block peak uses the full range. Loop buffers can go
+ * well past +-1 after a few overdubs, so a fixed int16 scale won't do.
+ **/
+class BlockFloat {
+public:
+    static float getPeak(const float* data, size_t size) {
+        float peak = 0;
+        for (size_t i = 0; i < size; i++) {
+            peak = max(peak, std::abs(data[i]));
+        }
+        return peak;
+    }
+    static int16_t quantize(float value) {
+        return (int16_t)(value + (value > 0 ? 0.5f : -0.5f));
+    }
+    /**
+     * @return scale factor for decoding
+     */
+    static float encode(const float* data, int16_t* samples, size_t size) {
+        float peak = getPeak(data, size);
+        float inverse = peak > 0 ? 32767 / peak : 0;
+        for (size_t i = 0; i < size; i++) {
+            samples[i] = quantize(data[i] * inverse);
+        }
+        return peak / 32767;
+    }
+    static void decode(const int16_t* samples, float scale, float* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            data[i] = samples[i] * scale;
+        }
+    }
+    /**
+     * Exchange block contents with encoded samples in place
+     * @return new scale factor for the samples
+     */
+    static float swap(float* data, int16_t* samples, float scale, size_t size) {
+        float peak = getPeak(data, size);
+        float inverse = peak > 0 ? 32767 / peak : 0;
+        for (size_t i = 0; i < size; i++) {
+            float value = data[i];
+            data[i] = samples[i] * scale;
+            samples[i] = quantize(value * inverse);
+        }
+        return peak / 32767;
+    }
+};
+
+#endif
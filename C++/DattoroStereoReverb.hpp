@@ -5,11 +5,37 @@
 
 class bypass { };
 
+/**
+ * Filter and allpass building blocks shared by the reverbs
+ **/
+class ReverbPrimitives {
+protected:
+    using DelayBuffer = InterpolatingCircularFloatBuffer<LINEAR_INTERPOLATION>;
+    float damping = 0;
+
+    inline void processLPF(float& state, float& value) {
+        state += damping * (value - state);
+        value = state;
+    }
+
+    inline void processHPF(float& state, float& value) {
+        state += damping * (value - state);
+        value = state;
+    }
+
+    inline void processAPF(DelayBuffer* delay, float& acc, float kap) {
+        float sample = delay->read();
+        acc += sample * kap;
+        delay->write(acc);
+        acc *= -kap;
+        acc += sample;
+    }
+};
+
 template <bool with_smear = false, typename Processor = bypass>
-class DattorroStereoReverb : public MultiSignalProcessor {
+class DattorroStereoReverb : public MultiSignalProcessor, protected ReverbPrimitives {
 private:
     using LFO = SineOscillator;
-    using DelayBuffer = InterpolatingCircularFloatBuffer<LINEAR_INTERPOLATION>;
     static constexpr size_t num_delays = 14;
     Processor** processors;
 
@@ -21,7 +47,6 @@ public:
         , delays(delays)
         , lfo1(lfo1)
         , lfo2(lfo2)
-        , damping(0)
         , lp1_state(0)
         , lp2_state(0)
         , hp1_state(0)
@@ -176,6 +201,10 @@ public:
         for (size_t i = 0; i < num_delays; i++) {
             delays[i]->clear();
         }
+        lp1_state = 0;
+        lp2_state = 0;
+        hp1_state = 0;
+        hp2_state = 0;
     }
 
     void setModulation(size_t offset1, size_t amount1, size_t offset2, size_t amount2) {
@@ -231,30 +260,11 @@ protected:
     float amount;
     float decay;
     float diffusion;
-    float damping;
     float lp1_state, lp2_state;
     float hp1_state, hp2_state, hpf_amount;
     size_t lfo_offset1, lfo_offset2;
     size_t lfo_amount1, lfo_amount2;
     FloatArray tmp;
-
-    inline void processLPF(float& state, float& value) {
-        state += damping * (value - state);
-        value = state;
-    }
-
-    inline void processHPF(float& state, float& value) {
-        state += damping * (value - state);
-        value = state;
-    }
-
-    inline void processAPF(DelayBuffer* delay, float& acc, float kap) {
-        float sample = delay->read();
-        acc += sample * kap;
-        delay->write(acc);
-        acc *= -kap;
-        acc += sample;
-    }
 };
 
 // Rings, elements - has longer tails. Second diffuser APF chain delays are improvised.
@@ -0,0 +1,276 @@
+#ifndef __FDN_REVERB_HPP__
+#define __FDN_REVERB_HPP__
+
+#include "OpenWareLibrary.h"
+#include "DattorroStereoReverb.hpp"
+
+enum FdnMixing {
+    FDN_HADAMARD,
+    FDN_HOUSEHOLDER,
+};
+
+/**
+ * Feedback delay network reverb with N lines (4 or 8).
+ *
+ * Each input channel goes through the same 4 AP diffusers as in the Dattorro
+ * reverb and is then injected into every other line. Lines are mixed through
+ * an orthogonal Hadamard or Householder matrix, so every line feeds every
+ * other one on each pass and echo density builds up much faster than in a
+ * figure-8 tank.
+ *
+ * Per-line state lives in arrays of N floats and every step after the delay
+ * reads is a plain loop over lines, so the compiler can map lines to SIMD
+ * lanes. The two first lines are modulated by the LFOs.
+ *
+ * create() and the setters match DattorroStereoReverb, so either can be
+ * used as a drop-in replacement for the other.
+ **/
+template <size_t N = 4, FdnMixing mixing = FDN_HADAMARD>
+class FdnReverb : public MultiSignalProcessor, protected ReverbPrimitives {
+private:
+    static_assert(N == 4 || N == 8, "FDN reverb supports 4 or 8 lines");
+    using LFO = SineOscillator;
+    static constexpr size_t num_diffusers = 8;
+    static constexpr size_t num_delays = num_diffusers + N;
+
+public:
+    FdnReverb(DelayBuffer** delays, LFO* lfo1, LFO* lfo2)
+        : delays(delays)
+        , lfo1(lfo1)
+        , lfo2(lfo2)
+        , amount(0)
+        , decay(0)
+        , diffusion(0)
+        , lfo_offset1(delays[num_diffusers]->getSize())
+        , lfo_offset2(delays[num_diffusers + 1]->getSize())
+        , lfo_amount1(0)
+        , lfo_amount2(0) {
+        lfo1->setFrequency(0.5);
+        lfo2->setFrequency(0.3);
+        for (size_t i = 0; i < num_delays; i++) {
+            delays[i]->setDelay((int)delays[i]->getSize());
+        }
+        for (size_t i = 0; i < N; i++) {
+            // Line length relative to half of the Dattorro tank, so that
+            // decay values give comparable tails
+            length_ratio[i] = delays[num_diffusers + i]->getSize() / 10000.0f;
+            lp_state[i] = 0;
+            hp_state[i] = 0;
+        }
+        setDecay(0);
+    }
+    void process(AudioBuffer& input, AudioBuffer& output) {
+        const float kap = diffusion;
+
+        size_t size = input.getSize();
+
+        float* left_in = input.getSamples(0).getData();
+        float* right_in = input.getSamples(1).getData();
+        float* left_out = output.getSamples(0).getData();
+        float* right_out = output.getSamples(1).getData();
+
+        DelayBuffer** lines = delays + num_diffusers;
+        size_t lfo1_read_offset = getReadOffset(lines[0], lfo_offset1, lfo_amount1);
+        size_t lfo2_read_offset = getReadOffset(lines[1], lfo_offset2, lfo_amount2);
+
+        float y[N];
+        while (size--) {
+            float left = *left_in;
+            float right = *right_in;
+
+            // Diffuse through 4 allpasses per channel.
+            for (size_t i = 0; i < 4; i++) {
+                processAPF(delays[i], left, kap);
+            }
+            for (size_t i = 4; i < 8; i++) {
+                processAPF(delays[i], right, kap);
+            }
+
+            // Line outputs, modulated for the first two lines
+            y[0] = lines[0]->readAt(
+                lfo1_read_offset++ - (lfo1->generate() + 1) * lfo_amount1);
+            y[1] = lines[1]->readAt(
+                lfo2_read_offset++ - (lfo2->generate() + 1) * lfo_amount2);
+            for (size_t i = 2; i < N; i++) {
+                y[i] = lines[i]->read();
+            }
+
+            // Everything below is lane-parallel
+            for (size_t i = 0; i < N; i++) {
+                processLPF(lp_state[i], y[i]);
+            }
+            float wet_left = 0;
+            float wet_right = 0;
+            for (size_t i = 0; i < N; i += 2) {
+                wet_left += y[i];
+                wet_right += y[i + 1];
+            }
+            mix(y);
+            for (size_t i = 0; i < N; i++) {
+                y[i] = y[i] * gain[i] + (i & 1 ? right : left);
+                processHPF(hp_state[i], y[i]);
+            }
+            for (size_t i = 0; i < N; i++) {
+                lines[i]->write(y[i]);
+            }
+
+            wet_left *= output_gain;
+            wet_right *= output_gain;
+            *left_out++ = *left_in + (wet_left - *left_in) * amount;
+            left_in++;
+            *right_out++ = *right_in + (wet_right - *right_in) * amount;
+            right_in++;
+        }
+    }
+
+    void setAmount(float amount) {
+        this->amount = amount;
+    }
+
+    void setDecay(float decay) {
+        this->decay = decay;
+        // Same decay per unit of time on every line
+        for (size_t i = 0; i < N; i++) {
+            gain[i] = powf(decay, length_ratio[i]);
+        }
+    }
+
+    void setDiffusion(float diffusion) {
+        this->diffusion = diffusion;
+    }
+
+    void setDamping(float damping) {
+        this->damping = damping;
+    }
+
+    void clear() {
+        for (size_t i = 0; i < num_delays; i++) {
+            delays[i]->clear();
+        }
+        for (size_t i = 0; i < N; i++) {
+            lp_state[i] = 0;
+            hp_state[i] = 0;
+        }
+    }
+
+    /**
+     * Modulated taps on the first two lines, in samples. Offsets are the
+     * delay of each tap and are limited to the line length, amounts are the
+     * modulation depth.
+     */
+    void setModulation(size_t offset1, size_t amount1, size_t offset2, size_t amount2) {
+        lfo_offset1 = offset1;
+        lfo_amount1 = amount1 / 2;
+        lfo_offset2 = offset2;
+        lfo_amount2 = amount2 / 2;
+    }
+
+    static FdnReverb* create(
+        size_t /* block_size */, float sr, const size_t* delay_lengths) {
+        DelayBuffer** delays = new DelayBuffer*[num_delays];
+        for (size_t i = 0; i < num_delays; i++) {
+            delays[i] = DelayBuffer::create(delay_lengths[i]);
+        }
+        return new FdnReverb(delays, LFO::create(sr), LFO::create(sr));
+    }
+
+    static void destroy(FdnReverb* reverb) {
+        LFO::destroy(reverb->lfo1);
+        LFO::destroy(reverb->lfo2);
+        for (size_t i = 0; i < num_delays; i++) {
+            DelayBuffer::destroy(reverb->delays[i]);
+        }
+        delete[] reverb->delays;
+        delete reverb;
+    }
+
+protected:
+    DelayBuffer** delays;
+    LFO* lfo1;
+    LFO* lfo2;
+    float amount;
+    float decay;
+    float diffusion;
+    size_t lfo_offset1, lfo_offset2;
+    size_t lfo_amount1, lfo_amount2;
+    float gain[N];
+    float length_ratio[N];
+    float lp_state[N];
+    float hp_state[N];
+    static constexpr float output_gain = 2.0f / N;
+
+    /**
+     * Read index of a modulated tap, the LFO lengthens the delay by up to
+     * twice the amount
+     */
+    static size_t getReadOffset(DelayBuffer* line, size_t offset, size_t amount) {
+        size_t size = line->getSize();
+        size_t tap = max(min(offset, size), amount * 2);
+        return line->getWriteIndex() + size - tap + amount * 2;
+    }
+    inline void mix(float* y) {
+        if constexpr (mixing == FDN_HADAMARD) {
+            // Fast Walsh-Hadamard transform, normalized to stay orthogonal
+            for (size_t h = 1; h < N; h *= 2) {
+                for (size_t i = 0; i < N; i += h * 2) {
+                    for (size_t j = i; j < i + h; j++) {
+                        float a = y[j];
+                        float b = y[j + h];
+                        y[j] = a + b;
+                        y[j + h] = a - b;
+                    }
+                }
+            }
+            const float scale = N == 4 ? 0.5f : 0.35355339f; // 1 / sqrt(N)
+            for (size_t i = 0; i < N; i++) {
+                y[i] *= scale;
+            }
+        }
+        else {
+            // I - 2/N * ones
+            float sum = 0;
+            for (size_t i = 0; i < N; i++) {
+                sum += y[i];
+            }
+            sum *= 2.0f / N;
+            for (size_t i = 0; i < N; i++) {
+                y[i] -= sum;
+            }
+        }
+    }
+};
+
+// Diffusers from the Rings set, followed by mutually prime line lengths
+const size_t fdn4_delays[] = {
+    150,
+    214,
+    319,
+    527,
+    126,
+    191,
+    344,
+    569,
+    2203,
+    2687,
+    3301,
+    3917,
+};
+const size_t fdn8_delays[] = {
+    150,
+    214,
+    319,
+    527,
+    126,
+    191,
+    344,
+    569,
+    1931,
+    2213,
+    2539,
+    2851,
+    3209,
+    3559,
+    3907,
+    4349,
+};
+#endif
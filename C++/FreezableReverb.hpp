@@ -0,0 +1,277 @@
+#ifndef __FREEZABLE_REVERB_HPP__
+#define __FREEZABLE_REVERB_HPP__
+
+#include "OpenWareLibrary.h"
+#include "PartitionedConvolution.hpp"
+#include "TaskScheduler.hpp"
+
+/**
+ * Convolution fast path for a recursive stereo reverb.
+ *
+ * Without a processor in the loop the tank is linear, and apart from the
+ * LFO it is also time invariant. Once decay, diffusion and damping have
+ * been static for a while, a second instance of the tank is fed one impulse
+ * per input channel in the background (a few partitions per block) and the
+ * captured responses are loaded into a partitioned convolution engine.
+ * Rendering then switches over to convolution. Any change of those
+ * parameters switches back to the tank immediately.
+ *
+ * Amount only sets the dry/wet mix, which is applied here, so it doesn't
+ * unfreeze the reverb.
+ *
+ * Both switches rely on superposition: the engine that is being switched
+ * away from keeps running on silence for the length of the impulse
+ * response, so the tail of what it already received rings out instead of
+ * being cut off.
+ *
+ * With a capture rate of 0 nothing is captured from process(), the reverb
+ * has to be added to a TaskScheduler that renders partitions in the time
+ * left over after audio processing.
+ **/
+template <typename Reverb>
+class FreezableReverb : public MultiSignalProcessor, public BackgroundTask {
+public:
+    enum FreezeState {
+        FREEZE_LIVE,
+        FREEZE_CAPTURING,
+        FREEZE_FROZEN,
+    };
+
+    FreezableReverb(Reverb* tank, Reverb* capture, PartitionedConvolution* convolution,
+        AudioBuffer* wet, AudioBuffer* tail, AudioBuffer* silence,
+        AudioBuffer* impulse)
+        : tank(tank)
+        , capture(capture)
+        , convolution(convolution)
+        , wet(wet)
+        , tail(tail)
+        , silence(silence)
+        , impulse(impulse)
+        , state(FREEZE_LIVE)
+        , amount(0)
+        , decay(0)
+        , diffusion(0)
+        , damping(0)
+        , tolerance(0.001)
+        , freeze_blocks(0)
+        , stable_blocks(0)
+        , capture_partitions(4)
+        , capture_offset(0)
+        , capture_channel(0)
+        , tank_tail(0)
+        , convolution_tail(0)
+        , enabled(true) {
+        tank->setAmount(1);
+        capture->setAmount(1);
+        silence->clear();
+    }
+    void process(AudioBuffer& input, AudioBuffer& output) override {
+        size_t size = input.getSize();
+        if (state == FREEZE_FROZEN) {
+            convolution->process(input, *wet);
+        }
+        else {
+            tank->process(input, *wet);
+        }
+        // Let the engine we switched away from ring out
+        if (tank_tail > 0) {
+            tank->process(*silence, *tail);
+            addTail();
+            tank_tail = tank_tail > size ? tank_tail - size : 0;
+        }
+        if (convolution_tail > 0) {
+            convolution->process(*silence, *tail);
+            addTail();
+            convolution_tail = convolution_tail > size ? convolution_tail - size : 0;
+        }
+        for (size_t ch = 0; ch < 2; ch++) {
+            float* in = input.getSamples(ch).getData();
+            float* w = wet->getSamples(ch).getData();
+            float* out = output.getSamples(ch).getData();
+            for (size_t i = 0; i < size; i++) {
+                out[i] = in[i] + (w[i] - in[i]) * amount;
+            }
+        }
+        if (state == FREEZE_CAPTURING) {
+            for (size_t n = 0; n < capture_partitions; n++) {
+                if (!capturePartition())
+                    break;
+            }
+        }
+        else if (state == FREEZE_LIVE && enabled && tank_tail == 0 &&
+            convolution_tail == 0 && ++stable_blocks > freeze_blocks) {
+            startCapture();
+        }
+    }
+    void setAmount(float amount) {
+        this->amount = amount;
+    }
+    void setDecay(float decay) {
+        if (changed(this->decay, decay))
+            unfreeze();
+        this->decay = decay;
+        tank->setDecay(decay);
+    }
+    void setDiffusion(float diffusion) {
+        if (changed(this->diffusion, diffusion))
+            unfreeze();
+        this->diffusion = diffusion;
+        tank->setDiffusion(diffusion);
+    }
+    void setDamping(float damping) {
+        if (changed(this->damping, damping))
+            unfreeze();
+        this->damping = damping;
+        tank->setDamping(damping);
+    }
+    void setModulation(size_t offset1, size_t amount1, size_t offset2, size_t amount2) {
+        unfreeze();
+        tank->setModulation(offset1, amount1, offset2, amount2);
+        capture->setModulation(offset1, amount1, offset2, amount2);
+    }
+    /**
+     * @param blocks number of blocks parameters must stay unchanged before
+     * the impulse response is captured
+     */
+    void setFreezeDelay(uint32_t blocks) {
+        freeze_blocks = blocks;
+    }
+    /**
+     * @param tolerance largest parameter change that doesn't unfreeze
+     */
+    void setTolerance(float tolerance) {
+        this->tolerance = tolerance;
+    }
+    /**
+     * @param partitions number of block_size partitions rendered per block
+     * while capturing, 0 to only capture from step()
+     */
+    void setCaptureRate(size_t partitions) {
+        capture_partitions = partitions;
+    }
+    void setEnabled(bool enabled) {
+        this->enabled = enabled;
+        if (!enabled)
+            unfreeze();
+    }
+    /**
+     * Render one partition of the impulse response while capturing
+     */
+    bool step() override {
+        return state == FREEZE_CAPTURING && capturePartition();
+    }
+    FreezeState getState() const {
+        return state;
+    }
+    void clear() {
+        tank->clear();
+        convolution->clear();
+        tank_tail = 0;
+        convolution_tail = 0;
+    }
+
+    template <typename... Args>
+    static FreezableReverb* create(size_t block_size, float sr, size_t ir_length,
+        size_t tail_partition_size, const size_t* delay_lengths, Args&&... args) {
+        return new FreezableReverb(
+            Reverb::create(block_size, sr, delay_lengths, std::forward<Args>(args)...),
+            Reverb::create(block_size, sr, delay_lengths, std::forward<Args>(args)...),
+            PartitionedConvolution::create(block_size, ir_length, tail_partition_size),
+            AudioBuffer::create(2, block_size), AudioBuffer::create(2, block_size),
+            AudioBuffer::create(2, block_size), AudioBuffer::create(2, block_size));
+    }
+    static void destroy(FreezableReverb* reverb) {
+        Reverb::destroy(reverb->tank);
+        Reverb::destroy(reverb->capture);
+        PartitionedConvolution::destroy(reverb->convolution);
+        AudioBuffer::destroy(reverb->wet);
+        AudioBuffer::destroy(reverb->tail);
+        AudioBuffer::destroy(reverb->silence);
+        AudioBuffer::destroy(reverb->impulse);
+        delete reverb;
+    }
+
+protected:
+    Reverb* tank;
+    Reverb* capture;
+    PartitionedConvolution* convolution;
+    AudioBuffer* wet;
+    AudioBuffer* tail;
+    AudioBuffer* silence;
+    AudioBuffer* impulse;
+    FreezeState state;
+    float amount;
+    float decay;
+    float diffusion;
+    float damping;
+    float tolerance;
+    uint32_t freeze_blocks;
+    uint32_t stable_blocks;
+    size_t capture_partitions;
+    size_t capture_offset;
+    size_t capture_channel;
+    size_t tank_tail;
+    size_t convolution_tail;
+    bool enabled;
+
+    bool changed(float old_value, float new_value) const {
+        return std::abs(new_value - old_value) > tolerance;
+    }
+    void addTail() {
+        for (size_t ch = 0; ch < 2; ch++) {
+            wet->getSamples(ch).add(tail->getSamples(ch));
+        }
+    }
+    void unfreeze() {
+        stable_blocks = 0;
+        if (state == FREEZE_FROZEN) {
+            // The tank still holds whatever is left of its own tail, new
+            // input is simply added on top of it
+            tank_tail = 0;
+            convolution_tail = convolution->getLength();
+        }
+        state = FREEZE_LIVE;
+    }
+    void startCapture() {
+        capture->setDecay(decay);
+        capture->setDiffusion(diffusion);
+        capture->setDamping(damping);
+        capture_offset = 0;
+        capture_channel = 0;
+        state = FREEZE_CAPTURING;
+    }
+    /**
+     * @return true while there is more to capture
+     */
+    bool capturePartition() {
+        impulse->clear();
+        if (capture_offset == 0) {
+            // Each response starts from an empty tank
+            capture->clear();
+            impulse->getSamples(capture_channel)[0] = 1;
+        }
+        capture->process(*impulse, *tail);
+        for (size_t ch = 0; ch < 2; ch++) {
+            convolution->setSegment(capture_channel, ch, capture_offset,
+                tail->getSamples(ch));
+        }
+        capture_offset += convolution->getBlockSize();
+        if (capture_offset >= convolution->getLength()) {
+            capture_offset = 0;
+            if (++capture_channel == 2) {
+                freeze();
+                return false;
+            }
+        }
+        return true;
+    }
+    void freeze() {
+        // Start convolving from silence and let the tank tail ring out
+        convolution->clear();
+        convolution_tail = 0;
+        tank_tail = convolution->getLength();
+        state = FREEZE_FROZEN;
+    }
+};
+
+#endif
@@ -6,9 +6,18 @@
 #include "daisysp.h"
 #include "DattorroStereoReverb.hpp"
 #include "Patch.h"
-#include "Nonlinearity.hpp"
+#include "SaturatorBank.hpp"
+#include "LoopHistory.hpp"
+#include "LoopStorage.hpp"
+#include "VarispeedReader.hpp"
+#include "HalfBandFilter.hpp"
+#include "BlockAggregator.hpp"
+#include "TaskScheduler.hpp"
 #include "SmoothValue.h"
 //#include "DryWetProcessor.h"
+#ifndef ARM_CORTEX
+#include <chrono>
+#endif
 
 // Changed Controls. A is now mix
 #define P_AMOUNT PARAMETER_B
@@ -17,12 +26,22 @@
 #define P_MIX PARAMETER_A
 #define P_MOD PARAMETER_E
 #define P_GAIN PARAMETER_AA
+#define P_CURVE PARAMETER_AB
+#define P_SPEED PARAMETER_AC
 
 #define MAX_BUF_SIZE (4 * 1024 * 1024 - 1024) // In bytes, per channel
 #define DELAY_CLEAR 500 // In ms
 #define DELAY_HALF 400
+#define HISTORY_SIZE (MAX_BUF_SIZE + MAX_BUF_SIZE / 64) // In bytes, undo for a full-buffer overdub
+#define HISTORY_CHUNK 1024 // In samples
+#define SAVE_CHUNK 1024 // In samples, written per background task step while saving
+#define LOOP_FILE "frippertronics.loop" // Host storage
+#define VARISPEED_FADE 256 // In samples, switching between looper and varispeed playback
+#define AGGREGATE_BLOCKS 1 // Reverb and saturator block, in host blocks. Adds n - 1 blocks of latency
+#define CURVE_HYSTERESIS 0.25 // In curve steps, knob travel past a boundary before the curve changes
+#define TASK_LOAD 0.8 // Share of the block period that audio and background tasks may use
+#define BLOCK_TICKS 1000000 // getClock() units per block period on the device
 
-using Saturator = AntialiasedThirdOrderPolynomial;
 using CloudsReverb = DattorroStereoReverb<>;
 
 const char* looper_modes[] = {
@@ -39,11 +58,47 @@ enum LooperState {
     ST_OVERDUB,
 };
 
+/**
+ * Stereo looper. The daisysp loopers do the actual recording and playback,
+ * this class mirrors their position so that overdubs can be recorded into
+ * an undo history, and saves or restores the loop.
+ *
+ * Playback at any other speed than the looper's own goes through a
+ * VarispeedReader on the loop buffers. The loopers keep running underneath
+ * and are crossfaded back in at unity speed or when an overdub starts,
+ * since they can only record at their own rate.
+ *
+ * In decimated mode the loopers run at half the sample rate, behind a
+ * half-band decimator and interpolator. The same buffers then hold twice
+ * the duration, at the cost of everything above a quarter of the sample
+ * rate. The varispeed reader reads the buffers directly at either rate.
+ **/
 class LooperProcessor : public MultiSignalProcessor {
 public:
-    LooperProcessor(daisysp::Looper** loopers, float* buf1, float* buf2, size_t max_size)
+    LooperProcessor(daisysp::Looper** loopers, float* buf1, float* buf2,
+        size_t max_size, LoopHistory* history, LoopWriter* writer,
+        VarispeedReader* varispeed, AudioBuffer* varispeed_out,
+        HalfBandDecimator** decimators, HalfBandInterpolator** interpolators,
+        FloatArray half_rate, FloatArray full_rate)
         : mix(0)
-        , loopers(loopers) {
+        , loopers(loopers)
+        , history(history)
+        , writer(writer)
+        , varispeed(varispeed)
+        , varispeed_out(varispeed_out)
+        , decimators(decimators)
+        , interpolators(interpolators)
+        , half_rate(half_rate)
+        , full_rate(full_rate)
+        , speed(1)
+        , varispeed_mix(0)
+        , max_size(max_size)
+        , state(ST_NONE)
+        , loop_length(0)
+        , position(0)
+        , is_reverse(false)
+        , is_half_speed(false)
+        , is_decimated(false) {
         buf[0] = buf1;
         buf[1] = buf2;
         loopers[0]->Init(buf1, max_size);
@@ -53,20 +108,201 @@ public:
     }
     void process(AudioBuffer& input, AudioBuffer& output) override {
         size_t size = output.getSize();
+        if (state == ST_OVERDUB)
+            saveHistory(size);
+        bool use_varispeed = isVarispeed();
+        if (use_varispeed && varispeed_mix == 0)
+            varispeed->setPosition(getPlaybackPosition());
+        if (use_varispeed || varispeed_mix > 0) {
+            float* out[2] = {varispeed_out->getSamples(0).getData(),
+                varispeed_out->getSamples(1).getData()};
+            float increment = getIncrement() * speed;
+            varispeed->process(buf, loop_length, is_reverse ? -increment : increment,
+                out, size);
+        }
+        float target = use_varispeed ? 1.0f : 0.0f;
+        float fade_step = 1.0f / VARISPEED_FADE;
+        float start_mix = varispeed_mix;
         for (size_t i = 0; i < 2; i++) {
             FloatArray in = input.getSamples(i);
             FloatArray out = output.getSamples(i);
+            FloatArray alt = varispeed_out->getSamples(i);
             auto looper = loopers[i];
+            if (is_decimated) {
+                decimators[i]->process(in.getData(), half_rate.getData(), size);
+                for (size_t j = 0; j < size / 2; j++) {
+                    half_rate[j] = looper->Process(half_rate[j]);
+                }
+                interpolators[i]->process(
+                    half_rate.getData(), full_rate.getData(), size / 2);
+            }
+            varispeed_mix = start_mix;
             for (size_t j = 0; j < size; j++) {
                 float in_sample = in[j];
-                float sample = looper->Process(in_sample);
+                float sample = is_decimated ? full_rate[j] : looper->Process(in_sample);
+                if (varispeed_mix != target) {
+                    varispeed_mix = target > varispeed_mix ?
+                        min(varispeed_mix + fade_step, target) :
+                        max(varispeed_mix - fade_step, target);
+                }
+                if (varispeed_mix > 0)
+                    sample += (alt[j] - sample) * varispeed_mix;
                 out[j] = in_sample + (sample - in_sample) * mix;
             }
         }
+        advance(size);
     }
     void setMix(float mix) {
         this->mix = mix;
     }
+    /**
+     * Playback speed relative to the looper's own, 1 bypasses varispeed
+     */
+    void setSpeed(float speed) {
+        this->speed = min(speed, VarispeedReader::MAX_SPEED);
+    }
+    /**
+     * Follow the patch state machine, overdubs become undo layers
+     * @return false if an overdub ended that can't be undone
+     */
+    bool setState(LooperState new_state) {
+        bool undoable = true;
+        if (state == ST_OVERDUB)
+            undoable = history->endLayer();
+        if (new_state != ST_PLAYBACK)
+            writer->abort(); // Loop contents are about to change
+        switch (new_state) {
+        case ST_NONE:
+        case ST_RECORDING:
+            history->reset();
+            loop_length = 0;
+            position = 0;
+            break;
+        case ST_PLAYBACK:
+            if (state == ST_RECORDING)
+                position = is_reverse ? loop_length - 1 : 0;
+            break;
+        case ST_OVERDUB:
+            history->beginLayer(loop_length);
+            break;
+        }
+        state = new_state;
+        return undoable;
+    }
+    bool undo() {
+        return history->undo();
+    }
+    /**
+     * An undo or redo is still being applied, overdubs have to wait
+     */
+    bool isHistoryBusy() const {
+        return history->isBusy();
+    }
+    bool isReverse() const {
+        return is_reverse;
+    }
+    bool isHalfSpeed() const {
+        return is_half_speed;
+    }
+    /**
+     * Record and play at half the sample rate, for loops of up to twice the
+     * length. Only possible while there is no loop.
+     */
+    bool setDecimated(bool decimated) {
+        if (state != ST_NONE)
+            return false;
+        if (decimated != is_decimated) {
+            for (size_t i = 0; i < 2; i++) {
+                decimators[i]->clear();
+                interpolators[i]->clear();
+            }
+            is_decimated = decimated;
+        }
+        return true;
+    }
+    bool isDecimated() const {
+        return is_decimated;
+    }
+    bool redo() {
+        return history->redo();
+    }
+    /**
+     * Undo, redo and saving are applied in the background
+     */
+    void addTasks(TaskScheduler* scheduler) {
+        scheduler->add(history);
+        scheduler->add(writer);
+    }
+    /**
+     * Start saving the loop in the background, one chunk per task step. Only
+     * possible during playback, the save is dropped if recording starts.
+     */
+    bool save(LoopStorage* storage, float sample_rate) {
+        if (state != ST_PLAYBACK || loop_length == 0 || writer->isBusy())
+            return false;
+        LoopFileHeader header = {};
+        header.magic = LoopFileHeader::MAGIC;
+        header.version = LoopFileHeader::VERSION;
+        header.channels = 2;
+        header.sample_rate = sample_rate;
+        header.length = loop_length;
+        header.mode = uint8_t(loopers[0]->GetMode());
+        header.reverse = is_reverse;
+        header.half_speed = is_half_speed;
+        header.decimated = is_decimated;
+        return writer->start(storage, buf[0], buf[1], header);
+    }
+    bool isSaving() const {
+        return writer->isBusy();
+    }
+    /**
+     * Restore a saved loop by recording it into the loopers in one go.
+     * Meant for patch startup, mapped storage is decoded in place.
+     * The caller is expected to switch to playback afterwards. Loops saved
+     * at another sample rate are rejected, they would play at the wrong
+     * pitch.
+     */
+    bool load(LoopStorage* storage, float sample_rate) {
+        LoopReader reader(storage);
+        if (!reader.isValid())
+            return false;
+        const LoopFileHeader& header = reader.getHeader();
+        if (header.chunk_size > max_size || header.sample_rate != uint32_t(sample_rate))
+            return false;
+        size_t length = min((size_t)header.length, max_size);
+        // Samples go into the buffers as they are, at the rate they were saved
+        setState(ST_NONE);
+        setDecimated(header.decimated);
+        setState(ST_RECORDING);
+        trigRecord();
+        float* left = new float[header.chunk_size];
+        float* right = new float[header.chunk_size];
+        uint8_t* scratch = new uint8_t[header.getChunkBytes()];
+        for (size_t chunk = 0; chunk * header.chunk_size < length; chunk++) {
+            size_t size = reader.readChunk(chunk, left, right, scratch);
+            size = min(size, length - chunk * header.chunk_size);
+            for (size_t i = 0; i < size; i++) {
+                loopers[0]->Process(left[i]);
+                loopers[1]->Process(right[i]);
+            }
+        }
+        delete[] left;
+        delete[] right;
+        delete[] scratch;
+        // Same sequence the patch uses to close the first recording
+        trigRecord();
+        trigRecord();
+        trigRecord();
+        loop_length = length;
+        while (uint8_t(loopers[0]->GetMode()) != header.mode % 4) {
+            incMode();
+        }
+        if (bool(header.reverse) != is_reverse)
+            toggleReverse();
+        if (bool(header.half_speed) != is_half_speed)
+            toggleHalfSpeed();
+        return true;
+    }
     void trigRecord() {
         loopers[0]->TrigRecord();
         loopers[1]->TrigRecord();
@@ -79,27 +315,52 @@ public:
     void toggleReverse() {
         loopers[0]->ToggleReverse();
         loopers[1]->ToggleReverse();
+        is_reverse = !is_reverse;
     }
     void toggleHalfSpeed() {
         loopers[0]->ToggleHalfSpeed();
         loopers[1]->ToggleHalfSpeed();
+        is_half_speed = !is_half_speed;
     }
     void clear() {
         loopers[0]->Clear();
         loopers[1]->Clear();
     }
-    static LooperProcessor* create(size_t max_size) {
+    static LooperProcessor* create(size_t max_size, size_t block_size) {
         max_size /= sizeof(float);
         auto loopers = new daisysp::Looper*[2];
         loopers[0] = new daisysp::Looper();
         loopers[1] = new daisysp::Looper();
-        return new LooperProcessor(
-            loopers, new float[max_size], new float[max_size], max_size);
+        float* buf1 = new float[max_size];
+        float* buf2 = new float[max_size];
+        auto decimators = new HalfBandDecimator*[2];
+        auto interpolators = new HalfBandInterpolator*[2];
+        for (int i = 0; i < 2; i++) {
+            decimators[i] = HalfBandDecimator::create();
+            interpolators[i] = HalfBandInterpolator::create();
+        }
+        return new LooperProcessor(loopers, buf1, buf2, max_size,
+            LoopHistory::create(buf1, buf2, max_size, HISTORY_CHUNK, HISTORY_SIZE),
+            LoopWriter::create(SAVE_CHUNK), VarispeedReader::create(),
+            AudioBuffer::create(2, block_size), decimators, interpolators,
+            FloatArray::create(block_size / 2), FloatArray::create(block_size));
     }
     static void destroy(LooperProcessor* processor) {
         for (int i = 0; i < 2; i++) {
             delete[] processor->buf[i];
         }
+        LoopHistory::destroy(processor->history);
+        LoopWriter::destroy(processor->writer);
+        VarispeedReader::destroy(processor->varispeed);
+        AudioBuffer::destroy(processor->varispeed_out);
+        for (int i = 0; i < 2; i++) {
+            HalfBandDecimator::destroy(processor->decimators[i]);
+            HalfBandInterpolator::destroy(processor->interpolators[i]);
+        }
+        delete[] processor->decimators;
+        delete[] processor->interpolators;
+        FloatArray::destroy(processor->half_rate);
+        FloatArray::destroy(processor->full_rate);
         delete[] processor->loopers;
         delete processor;
     }
@@ -108,15 +369,100 @@ private:
     daisysp::Looper** loopers;
     float* buf[2];
     float mix;
+    LoopHistory* history;
+    LoopWriter* writer;
+    VarispeedReader* varispeed;
+    AudioBuffer* varispeed_out;
+    HalfBandDecimator** decimators;
+    HalfBandInterpolator** interpolators;
+    FloatArray half_rate;
+    FloatArray full_rate;
+    float speed;
+    float varispeed_mix;
+    size_t max_size;
+    LooperState state;
+    size_t loop_length;
+    float position;
+    bool is_reverse, is_half_speed, is_decimated;
+
+    /**
+     * Buffer samples per output sample
+     */
+    float getIncrement() const {
+        float increment = is_half_speed ? 0.5f : 1.0f;
+        return is_decimated ? increment * 0.5f : increment;
+    }
+    /**
+     * Buffer position heard from the loopers, which lags behind their read
+     * position by the interpolator delay in decimated mode
+     */
+    float getPlaybackPosition() const {
+        if (!is_decimated || loop_length == 0)
+            return position;
+        float delay = HalfBandInterpolator::DELAY * 2 * getIncrement();
+        float pos = fmodf(is_reverse ? position + delay : position - delay, loop_length);
+        return pos < 0 ? pos + loop_length : pos;
+    }
+    bool isVarispeed() const {
+        return state == ST_PLAYBACK && speed != 1.0f && loop_length > 0;
+    }
+    /**
+     * Save every chunk that this block's overdub could write to. A chunk of
+     * margin on both sides covers any difference between our position
+     * estimate and the daisysp looper's own one.
+     */
+    void saveHistory(size_t size) {
+        if (loop_length == 0)
+            return;
+        size_t chunk = history->getChunkSize();
+        long span = ceilf(size * getIncrement());
+        long from = (is_reverse ? long(position) - span : long(position)) - long(chunk);
+        long to = from + span + 2 * long(chunk);
+        for (long pos = from;; pos += chunk) {
+            long wrapped = min(pos, to) % long(loop_length);
+            if (wrapped < 0)
+                wrapped += loop_length;
+            history->touch(wrapped / chunk);
+            if (pos >= to)
+                break;
+        }
+    }
+    void advance(size_t size) {
+        switch (state) {
+        case ST_RECORDING:
+            // One buffer sample per looper call
+            loop_length = min(loop_length + (is_decimated ? size / 2 : size), max_size);
+            break;
+        case ST_PLAYBACK:
+        case ST_OVERDUB:
+            if (loop_length > 0) {
+                float step = size * getIncrement();
+                position += is_reverse ? -step : step;
+                position = fmodf(position, loop_length);
+                if (position < 0)
+                    position += loop_length;
+            }
+            break;
+        default:
+            break;
+        }
+    }
 };
 
 class FrippertronicsPatch : public Patch {
 public:
     CloudsReverb* reverb;
     SmoothFloat gain;
-    Saturator* saturators[2];
+    SaturatorBank* saturator;
     LooperState state;
     LooperProcessor* looper;
+#ifndef ARM_CORTEX
+    LoopStorage* storage;
+#endif
+    BlockAggregator* effects;
+    TaskScheduler* tasks;
+    uint32_t task_budget;
+    size_t curve_index;
 
     SmoothFloat reverb_amount = SmoothFloat(0.99);
     SmoothFloat reverb_diffusion = SmoothFloat(0.99);
@@ -147,30 +493,69 @@ public:
         setParameterValue(P_MOD, 0.0);
         registerParameter(P_GAIN, "Gain");
         setParameterValue(P_GAIN, 1.0);
-        reverb = CloudsReverb::create(getBlockSize(), getSampleRate(), rings_delays);
+        registerParameter(P_SPEED, "Speed");
+        // Two octaves down to one up, unity at 2/3
+        setParameterValue(P_SPEED, 2.0 / 3);
+        registerParameter(P_CURVE, "Curve");
+        // Antialiased third order polynomial
+        setParameterValue(P_CURVE, (CURVE_THIRD_ORDER + 0.5) / (NUM_SATURATOR_CURVES * 2));
+        curve_index = CURVE_THIRD_ORDER;
+#ifndef ARM_CORTEX
+        // Patches can't write to flash, so loops are only kept between
+        // sessions on a host
+        storage = FileLoopStorage::create(LOOP_FILE);
+#endif
+        effects = BlockAggregator::create(getBlockSize(), AGGREGATE_BLOCKS);
+        size_t effects_block_size = effects->getInternalBlockSize();
+        reverb = CloudsReverb::create(effects_block_size, getSampleRate(), rings_delays);
         reverb->setModulation(4460, 40, 6261, 50);
-        saturators[0] = Saturator::create();
-        saturators[1] = Saturator::create();
-        looper = LooperProcessor::create(MAX_BUF_SIZE);
+        saturator = SaturatorBank::create(effects_block_size);
+        looper = LooperProcessor::create(MAX_BUF_SIZE, getBlockSize());
+        tasks = TaskScheduler::create();
+        looper->addTasks(tasks);
+#ifdef ARM_CORTEX
+        task_budget = BLOCK_TICKS * TASK_LOAD;
+#else
+        task_budget = 1e9 / getBlockRate() * TASK_LOAD;
+#endif
         state = ST_NONE;
+#ifndef ARM_CORTEX
+        // Pick up where the last session left off
+        if (looper->load(storage, getSampleRate())) {
+            setState(ST_PLAYBACK);
+            is_reverse = looper->isReverse();
+            is_half_speed = looper->isHalfSpeed();
+            debugMessage("Loaded");
+        }
+#endif
         delay_click = getBlockRate() / 1000 * DELAY_CLEAR;
         delay_half = getBlockRate() / 1000 * DELAY_HALF;
     }
     ~FrippertronicsPatch() {
         LooperProcessor::destroy(looper);
+#ifndef ARM_CORTEX
+        FileLoopStorage::destroy((FileLoopStorage*)storage);
+#endif
         CloudsReverb::destroy(reverb);
-        Saturator::destroy(saturators[0]);
-        Saturator::destroy(saturators[1]);
+        SaturatorBank::destroy(saturator);
+        BlockAggregator::destroy(effects);
+        TaskScheduler::destroy(tasks);
     }
     void buttonChanged(PatchButtonId bid, uint16_t value, uint16_t samples) override {
         switch (bid) {
         case BUTTON_A:
-            if (value) {
+            if (value && state == ST_PLAYBACK && looper->isHistoryBusy()) {
+                // The rest of the undo would overwrite the overdub
+                rec_timer = 0;
+                debugMessage("Busy");
+            }
+            else if (value) {
+                bool undoable = true;
                 looper->trigRecord();
                 switch (state) {
                 case ST_NONE:
                     is_record = true;
-                    state = ST_RECORDING;
+                    setState(ST_RECORDING);
                     break;
                 case ST_RECORDING:
                     // end recording and set the loop length
@@ -180,25 +565,28 @@ public:
                     // Changed so overdub is not engaged after first 
                     // recording of loop
                     is_record = false;
-                    state = ST_PLAYBACK;
+                    setState(ST_PLAYBACK);
                     break;
                 case ST_OVERDUB:
                     is_record = false;
-                    state = ST_PLAYBACK;
+                    undoable = setState(ST_PLAYBACK);
                     break;
                 case ST_PLAYBACK:
                     is_record = true;
-                    state = ST_OVERDUB;
+                    setState(ST_OVERDUB);
                     break;
                 }
-                debugMessage("Rec", (int)is_record);
+                if (undoable)
+                    debugMessage("Rec", (int)is_record);
+                else
+                    debugMessage("Overdub too long to undo");
                 rec_timer = 0;
             }
             else if (rec_timer > delay_click) {
                 // Falling edge after long press
                 looper->clear();
                 is_record = false;
-                state = ST_NONE;
+                setState(ST_NONE);
                 debugMessage("CLEAR");
             }
             break;
@@ -235,11 +623,62 @@ public:
                 debugMessage("Mode");
             }
             break;
+        case BUTTON_E:
+            // Undo last overdub, only while playing back
+            if (value && state == ST_PLAYBACK) {
+                debugMessage("Undo", (int)looper->undo());
+            }
+            break;
+        case BUTTON_F:
+            if (value && state == ST_PLAYBACK) {
+                debugMessage("Redo", (int)looper->redo());
+            }
+            break;
+#ifndef ARM_CORTEX
+        case BUTTON_G:
+            if (value) {
+                debugMessage("Save", (int)looper->save(storage, getSampleRate()));
+            }
+            break;
+#endif
+        case BUTTON_H:
+            // Double length loops at half the sample rate, only before recording
+            if (value && looper->setDecimated(!looper->isDecimated())) {
+                debugMessage("Long", (int)looper->isDecimated());
+            }
+            break;
         default:
             break;
         }
     }
+    bool setState(LooperState new_state) {
+        state = new_state;
+        return looper->setState(new_state);
+    }
+    /**
+     * Block time on the device, in BLOCK_TICKS per block period, so that
+     * budgets don't depend on the core clock. Nanoseconds on a host.
+     */
+    uint32_t getClock() {
+#ifdef ARM_CORTEX
+        return getElapsedBlockTime() * BLOCK_TICKS;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+    /**
+     * Speed from the parameter, snapped to unity around the center detent
+     */
+    float getSpeed() {
+        float octaves = getParameterValue(P_SPEED) * 3 - 2;
+        if (fabsf(octaves) < 0.02f)
+            return 1.0f;
+        return exp2f(octaves);
+    }
     void processAudio(AudioBuffer& buffer) {
+        uint32_t start = getClock();
         if (rec_timer < 0xffff)
             rec_timer++;
 
@@ -250,25 +689,10 @@ public:
         buffer.multiply(gain);
 
         looper->setMix(getParameterValue(P_MIX));
+        looper->setSpeed(getSpeed());
         looper->process(buffer, buffer);
 
-        ext_mod = getParameterValue(P_MOD);
-        float raw_amount = getParameterValue(P_AMOUNT);
-        reverb_amount = raw_amount + (0.998 - raw_amount) * ext_mod;
-        reverb_amount = getParameterValue(P_AMOUNT);
-        reverb->setAmount(reverb_amount);
-        reverb->setDecay(0.35 + reverb_amount * 0.63);
-        reverb_diffusion = getParameterValue(P_DIFFUSION);
-        reverb->setDiffusion(reverb_diffusion);
-        float raw_damping = getParameterValue(P_DAMP);
-        reverb_damping = raw_damping + (0.998 - raw_damping) * ext_mod;
-        reverb->setDamping(reverb_damping);
-        reverb->process(buffer, buffer);
-
-        for (int i = 0; i < 2; i++) {
-            FloatArray t = buffer.getSamples(i);
-            saturators[i]->process(t, t);
-        }
+        effects->process(buffer, [this](AudioBuffer& block) { processEffects(block); });
 
         switch (state) {
         case ST_NONE:
@@ -283,5 +707,33 @@ public:
             break;
         }
         setButton(BUTTON_3, led_mode, 0);
+
+        // Background work in whatever is left of the block
+        tasks->run([this]() { return getClock(); }, start, task_budget);
+    }
+    /**
+     * Reverb and saturator, on blocks of AGGREGATE_BLOCKS host blocks
+     */
+    void processEffects(AudioBuffer& buffer) {
+        ext_mod = getParameterValue(P_MOD);
+        float raw_amount = getParameterValue(P_AMOUNT);
+        reverb_amount = raw_amount + (0.998 - raw_amount) * ext_mod;
+        reverb_amount = getParameterValue(P_AMOUNT);
+        reverb->setAmount(reverb_amount);
+        reverb->setDecay(0.35 + reverb_amount * 0.63);
+        reverb_diffusion = getParameterValue(P_DIFFUSION);
+        reverb->setDiffusion(reverb_diffusion);
+        float raw_damping = getParameterValue(P_DAMP);
+        reverb_damping = raw_damping + (0.998 - raw_damping) * ext_mod;
+        reverb->setDamping(reverb_damping);
+        reverb->process(buffer, buffer);
+
+        // A knob resting on a boundary would otherwise flip between curves
+        float curve = getParameterValue(P_CURVE) * NUM_SATURATOR_CURVES * 2;
+        if (curve < curve_index - CURVE_HYSTERESIS ||
+            curve > curve_index + 1 + CURVE_HYSTERESIS)
+            curve_index = curve;
+        saturator->setCurve(curve_index);
+        saturator->process(buffer, buffer);
     }
 };
@@ -0,0 +1,143 @@
+#ifndef __HALF_BAND_FILTER_HPP__
+#define __HALF_BAND_FILTER_HPP__
+
+#include "OpenWareLibrary.h"
+
+#define HALFBAND_PAIRS 12 // Nonzero coefficient pairs, 4 * pairs - 1 taps
+
+/**
+ * Coefficients of a Blackman windowed half-band FIR.
+ *
+ * Apart from the center tap of 0.5 every other tap of a half-band filter
+ * is zero, and the rest is symmetric, so only one coefficient per pair of
+ * odd offsets from the center is stored.
+ **/
+class HalfBandKernel {
+public:
+    static constexpr size_t TAPS = 4 * HALFBAND_PAIRS - 1;
+
+    static void build(float* coefficients) {
+        float sum = 0;
+        for (size_t k = 0; k < HALFBAND_PAIRS; k++) {
+            float x = 2 * k + 1;
+            float w = 0.5f + x / (TAPS + 1);
+            float window =
+                0.42f - 0.5f * cosf(2 * M_PI * w) + 0.08f * cosf(4 * M_PI * w);
+            coefficients[k] = sinf(M_PI * x / 2) / (M_PI * x) * window;
+            sum += coefficients[k];
+        }
+        // Unity gain at DC: 0.5 + 2 * sum
+        for (size_t k = 0; k < HALFBAND_PAIRS; k++) {
+            coefficients[k] *= 0.25f / sum;
+        }
+    }
+};
+
+/**
+ * Mono 2:1 decimator, size input samples give size / 2 output samples
+ *
+ * The delay line is written twice, TAPS apart, so the last TAPS samples
+ * can always be read contiguously.
+ **/
+class HalfBandDecimator {
+public:
+    HalfBandDecimator(float* coefficients, float* history)
+        : coefficients(coefficients)
+        , history(history)
+        , index(0) {
+        clear();
+    }
+    void process(const float* input, float* output, size_t size) {
+        const size_t mid = HalfBandKernel::TAPS / 2;
+        for (size_t i = 0; i + 1 < size; i += 2) {
+            push(input[i]);
+            push(input[i + 1]);
+            const float* x = history + index; // Oldest first
+            float sum = 0.5f * x[mid];
+            for (size_t k = 0; k < HALFBAND_PAIRS; k++) {
+                sum += coefficients[k] * (x[mid - 1 - 2 * k] + x[mid + 1 + 2 * k]);
+            }
+            output[i / 2] = sum;
+        }
+    }
+    void clear() {
+        memset(history, 0, 2 * HalfBandKernel::TAPS * sizeof(float));
+    }
+    static HalfBandDecimator* create() {
+        float* coefficients = new float[HALFBAND_PAIRS];
+        HalfBandKernel::build(coefficients);
+        return new HalfBandDecimator(coefficients, new float[2 * HalfBandKernel::TAPS]);
+    }
+    static void destroy(HalfBandDecimator* decimator) {
+        delete[] decimator->coefficients;
+        delete[] decimator->history;
+        delete decimator;
+    }
+
+private:
+    float* coefficients;
+    float* history;
+    size_t index;
+
+    inline void push(float sample) {
+        history[index] = sample;
+        history[index + HalfBandKernel::TAPS] = sample;
+        if (++index == HalfBandKernel::TAPS)
+            index = 0;
+    }
+};
+
+/**
+ * Mono 1:2 interpolator, size input samples give 2 * size output samples
+ *
+ * Of each output pair the first one falls on an input sample, which the
+ * half-band filter passes through unchanged, so only the second one is
+ * filtered. Output is delayed by DELAY input samples.
+ **/
+class HalfBandInterpolator {
+public:
+    static constexpr size_t TAPS = 2 * HALFBAND_PAIRS;
+    static constexpr size_t DELAY = HALFBAND_PAIRS;
+
+    HalfBandInterpolator(float* coefficients, float* history)
+        : coefficients(coefficients)
+        , history(history)
+        , index(0) {
+        clear();
+    }
+    void process(const float* input, float* output, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            history[index] = input[i];
+            history[index + TAPS] = input[i];
+            if (++index == TAPS)
+                index = 0;
+            const float* x = history + index; // Oldest first
+            float sum = 0;
+            for (size_t k = 0; k < HALFBAND_PAIRS; k++) {
+                sum += coefficients[k] * (x[TAPS / 2 - 1 - k] + x[TAPS / 2 + k]);
+            }
+            output[2 * i] = x[TAPS / 2 - 1];
+            output[2 * i + 1] = 2 * sum;
+        }
+    }
+    void clear() {
+        memset(history, 0, 2 * TAPS * sizeof(float));
+    }
+    static HalfBandInterpolator* create() {
+        float* coefficients = new float[HALFBAND_PAIRS];
+        HalfBandKernel::build(coefficients);
+        return new HalfBandInterpolator(coefficients, new float[2 * TAPS]);
+    }
+    static void destroy(HalfBandInterpolator* interpolator) {
+        delete[] interpolator->coefficients;
+        delete[] interpolator->history;
+        delete interpolator;
+    }
+
+private:
+    float* coefficients;
+    float* history;
+    size_t index;
+};
+
+#endif
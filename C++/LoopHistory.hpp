@@ -0,0 +1,247 @@
+#ifndef __LOOP_HISTORY_HPP__
+#define __LOOP_HISTORY_HPP__
+
+#include "OpenWareLibrary.h"
+#include "BlockFloat.hpp"
+#include "TaskScheduler.hpp"
+
+#define LOOP_HISTORY_LAYERS 16
+
+/**
+ * Undo/redo history for overdubs on a stereo loop buffer.
+ *
+ * Only chunks that an overdub actually touches are stored, as 16 bit block
+ * floating point. A record holds the contents of its
+ * chunk from "the other side" of its layer: undoing a layer swaps every
+ * record with the loop buffer, which turns the undo data into redo data and
+ * the other way around.
+ *
+ * Records live in a fixed pool that is used as a FIFO, when it runs out the
+ * oldest layers are dropped. That only happens if the loop is short enough
+ * for the new layer to fit once they are gone: otherwise the new layer
+ * could still overflow, so the existing layers are kept and the new one is
+ * stored in free space only, or not at all.
+ *
+ * Undo and redo are applied one record per step() from a TaskScheduler, so
+ * they never stall the audio callback. No new layer can start until they
+ * are done, since the overdub would be overwritten by the remaining
+ * records.
+ **/
+class LoopHistory : public BackgroundTask {
+public:
+    struct Record {
+        uint32_t chunk;
+        float scale[2];
+        int16_t* samples[2];
+    };
+    struct Layer {
+        size_t first;
+        size_t count;
+        bool overflow;
+    };
+
+    LoopHistory(float* buf1, float* buf2, size_t buffer_size, size_t chunk_size,
+        Record* records, size_t capacity, int16_t* pool, uint32_t* dirty)
+        : buffer_size(buffer_size)
+        , chunk_size(chunk_size)
+        , records(records)
+        , capacity(capacity)
+        , pool(pool)
+        , dirty(dirty) {
+        buf[0] = buf1;
+        buf[1] = buf2;
+        for (size_t i = 0; i < capacity; i++) {
+            records[i].samples[0] = pool + i * chunk_size * 2;
+            records[i].samples[1] = pool + i * chunk_size * 2 + chunk_size;
+        }
+        reset();
+    }
+    /**
+     * Forget all layers
+     */
+    void reset() {
+        head = 0;
+        used = 0;
+        num_layers = 0;
+        applied_layers = 0;
+        recording = false;
+        can_drop = false;
+        pending = nullptr;
+    }
+    /**
+     * Start recording a new layer. Any layers that could be redone are
+     * discarded.
+     * @param loop_length in samples, the layer touches at most every chunk
+     * of the loop once
+     * @return false while an undo or redo is still being applied
+     */
+    bool beginLayer(size_t loop_length) {
+        if (pending != nullptr)
+            return false;
+        while (num_layers > applied_layers) {
+            Layer& layer = layers[--num_layers];
+            used -= layer.count;
+            head = (head + capacity - layer.count) % capacity;
+        }
+        if (num_layers == LOOP_HISTORY_LAYERS)
+            dropOldest();
+        Layer& layer = layers[num_layers++];
+        layer.first = head;
+        layer.count = 0;
+        layer.overflow = false;
+        can_drop = (loop_length + chunk_size - 1) / chunk_size <= capacity;
+        memset(dirty, 0, dirtyWords() * sizeof(uint32_t));
+        recording = true;
+        return true;
+    }
+    /**
+     * @return false if the layer couldn't be stored and can't be undone
+     */
+    bool endLayer() {
+        if (!recording)
+            return true;
+        recording = false;
+        Layer& layer = layers[num_layers - 1];
+        bool overflow = layer.overflow;
+        if (layer.count == 0 || overflow) {
+            // Nothing to undo, or not everything could be stored
+            used -= layer.count;
+            head = (head + capacity - layer.count) % capacity;
+            num_layers--;
+        }
+        applied_layers = num_layers;
+        return !overflow;
+    }
+    /**
+     * Save a chunk before the current layer writes to it for the first time
+     * @param chunk chunk index, i.e. buffer position / chunk size
+     */
+    void touch(uint32_t chunk) {
+        if (!recording || isDirty(chunk))
+            return;
+        Layer& layer = layers[num_layers - 1];
+        if (layer.overflow)
+            return;
+        if (used == capacity) {
+            if (num_layers == 1 || !can_drop) {
+                // Older layers stay undoable, this one is discarded
+                layer.overflow = true;
+                return;
+            }
+            dropOldest();
+        }
+        Record& record = records[head];
+        head = (head + 1) % capacity;
+        used++;
+        layers[num_layers - 1].count++;
+        record.chunk = chunk;
+        for (size_t ch = 0; ch < 2; ch++) {
+            float* data = buf[ch] + chunk * chunk_size;
+            size_t size = getChunkLength(chunk);
+            record.scale[ch] = BlockFloat::encode(data, record.samples[ch], size);
+        }
+        dirty[chunk / 32] |= 1u << (chunk % 32);
+    }
+    bool undo() {
+        if (recording || pending != nullptr || applied_layers == 0)
+            return false;
+        pending = &layers[--applied_layers];
+        pending_index = 0;
+        return true;
+    }
+    bool redo() {
+        if (recording || pending != nullptr || applied_layers == num_layers)
+            return false;
+        pending = &layers[applied_layers++];
+        pending_index = 0;
+        return true;
+    }
+    /**
+     * Restore one chunk of a pending undo or redo
+     */
+    bool step() override {
+        if (pending == nullptr)
+            return false;
+        apply(1);
+        return pending != nullptr;
+    }
+    size_t getChunkSize() const {
+        return chunk_size;
+    }
+    size_t getUndoLayers() const {
+        return applied_layers;
+    }
+    size_t getRedoLayers() const {
+        return num_layers - applied_layers;
+    }
+    bool isBusy() const {
+        return pending != nullptr;
+    }
+
+    static LoopHistory* create(float* buf1, float* buf2, size_t buffer_size,
+        size_t chunk_size, size_t max_bytes) {
+        size_t capacity = max_bytes / (sizeof(Record) + chunk_size * 2 * sizeof(int16_t));
+        size_t chunks = (buffer_size + chunk_size - 1) / chunk_size;
+        return new LoopHistory(buf1, buf2, buffer_size, chunk_size,
+            new Record[capacity], capacity, new int16_t[capacity * chunk_size * 2],
+            new uint32_t[(chunks + 31) / 32]);
+    }
+    static void destroy(LoopHistory* history) {
+        delete[] history->pool;
+        delete[] history->records;
+        delete[] history->dirty;
+        delete history;
+    }
+
+private:
+    float* buf[2];
+    size_t buffer_size;
+    size_t chunk_size;
+    Record* records;
+    size_t capacity;
+    int16_t* pool;
+    uint32_t* dirty;
+    Layer layers[LOOP_HISTORY_LAYERS];
+    size_t num_layers;
+    size_t applied_layers;
+    size_t head;
+    size_t used;
+    bool recording;
+    bool can_drop;
+    Layer* pending;
+    size_t pending_index;
+
+    size_t dirtyWords() const {
+        return ((buffer_size + chunk_size - 1) / chunk_size + 31) / 32;
+    }
+    bool isDirty(uint32_t chunk) const {
+        return dirty[chunk / 32] & (1u << (chunk % 32));
+    }
+    size_t getChunkLength(uint32_t chunk) const {
+        return min(chunk_size, buffer_size - chunk * chunk_size);
+    }
+    void dropOldest() {
+        used -= layers[0].count;
+        for (size_t i = 1; i < num_layers; i++) {
+            layers[i - 1] = layers[i];
+        }
+        num_layers--;
+        if (applied_layers > 0)
+            applied_layers--;
+    }
+    void apply(size_t count) {
+        while (count-- && pending_index < pending->count) {
+            swap(records[(pending->first + pending_index++) % capacity]);
+        }
+        if (pending_index == pending->count)
+            pending = nullptr;
+    }
+    void swap(Record& record) {
+        for (size_t ch = 0; ch < 2; ch++) {
+            record.scale[ch] = BlockFloat::swap(buf[ch] + record.chunk * chunk_size,
+                record.samples[ch], record.scale[ch], getChunkLength(record.chunk));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef __LOOP_STORAGE_HPP__
+#define __LOOP_STORAGE_HPP__
+
+#include "OpenWareLibrary.h"
+#include "BlockFloat.hpp"
+#include "TaskScheduler.hpp"
+
+/**
+ * Storage backend for saved loops. Writes happen in one session between
+ * begin() and finish(), reads can come straight from a memory mapping when
+ * the backend supports it.
+ **/
+class LoopStorage {
+public:
+    virtual ~LoopStorage() = default;
+    /**
+     * Start a new save of up to size bytes, previous content becomes invalid
+     */
+    virtual bool begin(size_t size) = 0;
+    virtual bool write(size_t offset, const void* data, size_t length) = 0;
+    virtual bool finish() = 0;
+    virtual bool read(size_t offset, void* data, size_t length) = 0;
+    /**
+     * @return pointer to stored data or nullptr if it can't be mapped
+     */
+    virtual const uint8_t* map() {
+        return nullptr;
+    }
+};
+
+#ifndef ARM_CORTEX
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Host file backend. A save goes to a temporary file that replaces the
+ * previous one on finish(), so an interrupted save never destroys a loop.
+ **/
+class FileLoopStorage : public LoopStorage {
+public:
+    FileLoopStorage(const char* path)
+        : file(nullptr)
+        , mapping(nullptr)
+        , mapping_size(0) {
+        snprintf(this->path, sizeof(this->path), "%s", path);
+        snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    }
+    ~FileLoopStorage() {
+        unmap();
+        if (file != nullptr)
+            fclose(file);
+    }
+    bool begin(size_t /* size */) override {
+        if (file != nullptr)
+            fclose(file);
+        file = fopen(temp_path, "wb");
+        return file != nullptr;
+    }
+    bool write(size_t offset, const void* data, size_t length) override {
+        return file != nullptr && fseek(file, offset, SEEK_SET) == 0 &&
+            fwrite(data, 1, length, file) == length;
+    }
+    bool finish() override {
+        if (file == nullptr)
+            return false;
+        bool ok = fclose(file) == 0;
+        file = nullptr;
+        unmap();
+        return ok && rename(temp_path, path) == 0;
+    }
+    bool read(size_t offset, void* data, size_t length) override {
+        const uint8_t* src = map();
+        if (src == nullptr || offset + length > mapping_size)
+            return false;
+        memcpy(data, src + offset, length);
+        return true;
+    }
+    const uint8_t* map() override {
+        if (mapping == nullptr) {
+            int fd = open(path, O_RDONLY);
+            if (fd < 0)
+                return nullptr;
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED) {
+                    mapping = (const uint8_t*)addr;
+                    mapping_size = st.st_size;
+                }
+            }
+            close(fd);
+        }
+        return mapping;
+    }
+    static FileLoopStorage* create(const char* path) {
+        return new FileLoopStorage(path);
+    }
+    static void destroy(FileLoopStorage* storage) {
+        delete storage;
+    }
+
+private:
+    char path[256];
+    char temp_path[260];
+    FILE* file;
+    const uint8_t* mapping;
+    size_t mapping_size;
+
+    void unmap() {
+        if (mapping != nullptr)
+            munmap((void*)mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+    }
+};
+#endif
+
+/**
+ * Saved loop layout: a header followed by fixed-size chunks, each holding
+ * two scale factors and the block floating point samples of both channels.
+ * Decoding is a multiply per sample, and a chunk can be decoded straight
+ * from mapped storage.
+ **/
+struct LoopFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t length;
+    uint32_t chunk_size;
+    uint8_t mode;
+    uint8_t reverse;
+    uint8_t half_speed;
+    uint8_t decimated; // Stored at half the sample rate
+
+    static constexpr uint32_t MAGIC = 0x504c574f; // "OWLP"
+    static constexpr uint16_t VERSION = 1;
+    static constexpr size_t SIZE = 32;
+
+    bool isValid() const {
+        return magic == MAGIC && version == VERSION && channels == 2 &&
+            chunk_size > 0 && length > 0;
+    }
+    size_t getChunkBytes() const {
+        return 2 * sizeof(float) + 2 * chunk_size * sizeof(int16_t);
+    }
+    size_t getNumChunks() const {
+        return (length + chunk_size - 1) / chunk_size;
+    }
+    size_t getChunkOffset(size_t chunk) const {
+        return SIZE + chunk * getChunkBytes();
+    }
+    size_t getTotalSize() const {
+        return getChunkOffset(getNumChunks());
+    }
+};
+
+/**
+ * Writes a loop to storage one chunk per step() call, meant to run from a
+ * TaskScheduler
+ **/
+class LoopWriter : public BackgroundTask {
+public:
+    LoopWriter(size_t chunk_size, uint8_t* staging)
+        : chunk_size(chunk_size)
+        , staging(staging)
+        , storage(nullptr)
+        , next_chunk(0) {
+    }
+    bool start(LoopStorage* storage, float* left, float* right,
+        const LoopFileHeader& header) {
+        this->header = header;
+        this->header.chunk_size = chunk_size;
+        if (!storage->begin(this->header.getTotalSize()))
+            return false;
+        this->storage = storage;
+        buf[0] = left;
+        buf[1] = right;
+        next_chunk = 0;
+        return true;
+    }
+    /**
+     * Encode and write the next chunk, the header goes last so that an
+     * unfinished save is never mistaken for a valid one.
+     * @return false once the save is complete or failed
+     */
+    bool step() override {
+        if (storage == nullptr)
+            return false;
+        if (next_chunk == header.getNumChunks()) {
+            storage->write(0, &header, sizeof(header));
+            storage->finish();
+            storage = nullptr;
+            return false;
+        }
+        size_t offset = next_chunk * chunk_size;
+        size_t size = min(chunk_size, (size_t)header.length - offset);
+        float* scales = (float*)staging;
+        int16_t* samples = (int16_t*)(staging + 2 * sizeof(float));
+        memset(samples, 0, 2 * chunk_size * sizeof(int16_t));
+        for (size_t ch = 0; ch < 2; ch++) {
+            scales[ch] = BlockFloat::encode(
+                buf[ch] + offset, samples + ch * chunk_size, size);
+        }
+        if (!storage->write(header.getChunkOffset(next_chunk), staging,
+                header.getChunkBytes())) {
+            storage = nullptr;
+            return false;
+        }
+        next_chunk++;
+        return true;
+    }
+    void abort() {
+        storage = nullptr;
+    }
+    bool isBusy() const {
+        return storage != nullptr;
+    }
+    static LoopWriter* create(size_t chunk_size) {
+        return new LoopWriter(chunk_size,
+            new uint8_t[2 * sizeof(float) + 2 * chunk_size * sizeof(int16_t)]);
+    }
+    static void destroy(LoopWriter* writer) {
+        delete[] writer->staging;
+        delete writer;
+    }
+
+private:
+    size_t chunk_size;
+    uint8_t* staging;
+    LoopStorage* storage;
+    LoopFileHeader header;
+    float* buf[2];
+    size_t next_chunk;
+};
+
+/**
+ * Decodes a saved loop, reading chunks in place when storage is mapped
+ **/
+class LoopReader {
+public:
+    LoopReader(LoopStorage* storage)
+        : storage(storage)
+        , mapped(storage->map()) {
+        uint8_t last;
+        if (!storage->read(0, &header, sizeof(header)) || !header.isValid() ||
+            !storage->read(header.getTotalSize() - 1, &last, 1))
+            header.magic = 0; // Missing or truncated
+    }
+    bool isValid() const {
+        return header.isValid();
+    }
+    const LoopFileHeader& getHeader() const {
+        return header;
+    }
+    /**
+     * Decode one chunk into left/right, which must hold chunk_size samples
+     * @param scratch getChunkBytes() bytes, only used for unmapped storage
+     * @return number of samples decoded
+     */
+    size_t readChunk(size_t chunk, float* left, float* right, uint8_t* scratch) {
+        const uint8_t* src = scratch;
+        size_t offset = header.getChunkOffset(chunk);
+        if (mapped != nullptr)
+            src = mapped + offset;
+        else if (!storage->read(offset, scratch, header.getChunkBytes()))
+            return 0;
+        float scales[2];
+        memcpy(scales, src, sizeof(scales));
+        const int16_t* samples = (const int16_t*)(src + sizeof(scales));
+        size_t size = min((size_t)header.chunk_size,
+            (size_t)header.length - chunk * header.chunk_size);
+        BlockFloat::decode(samples, scales[0], left, size);
+        BlockFloat::decode(samples + header.chunk_size, scales[1], right, size);
+        return size;
+    }
+
+private:
+    LoopStorage* storage;
+    const uint8_t* mapped;
+    LoopFileHeader header;
+};
+
+#endif
@@ -377,9 +377,18 @@ public:
     }
     float antialiasedClipN1(float x) {
         Fn = Function::getAntiderivative1(x);
+        return antialiasedSample(x, Fn, xn1, Fn1);
+    }
+
+    /**
+     * First order ADAA step on external state, for processors that keep
+     * their own xn1/Fn1
+     * @param Fn antiderivative at x
+     */
+    static inline float antialiasedSample(float x, float Fn, float& xn1, float& Fn1) {
         float tmp = 0.0;
         if (std::abs(x - xn1) < thresh) {
-            tmp = this->getSample(0.5f * (x + xn1));
+            tmp = Function::getSample(0.5f * (x + xn1));
         }
         else {
             tmp = (Fn - Fn1) / (x - xn1);
@@ -0,0 +1,281 @@
+#ifndef __PARTITIONED_CONVOLUTION_HPP__
+#define __PARTITIONED_CONVOLUTION_HPP__
+
+#include "OpenWareLibrary.h"
+#include "RealFFT.hpp"
+
+/**
+ * Uniformly partitioned overlap-save convolution of a stereo input with a
+ * 2x2 set of impulse responses (left->left, left->right, right->left,
+ * right->right). Input spectra are shared by both outputs, so each block
+ * costs two forward and two inverse FFTs plus the spectral multiply-adds.
+ *
+ * Spectra use the packed layout of RealFFT, where bin 0 holds DC in re and
+ * Nyquist in im, so that bin is multiplied component-wise.
+ **/
+class ConvolutionStage {
+public:
+    ConvolutionStage(RealFFT* fft, size_t partition_size,
+        size_t num_partitions, ComplexFloat* filters, ComplexFloat* fdl,
+        FloatArray* inputs, ComplexFloatArray accumulator, FloatArray buffer)
+        : fft(fft)
+        , partition_size(partition_size)
+        , num_partitions(num_partitions)
+        , filters(filters)
+        , fdl(fdl)
+        , accumulator(accumulator)
+        , buffer(buffer)
+        , current(0) {
+        this->inputs[0] = inputs[0];
+        this->inputs[1] = inputs[1];
+        clearFilters();
+        clear();
+    }
+    /**
+     * Set one partition of the impulse response for an input/output pair.
+     * @param segment time domain samples, up to one partition long
+     */
+    void setPartition(size_t in, size_t out, size_t index, FloatArray segment) {
+        buffer.clear();
+        for (size_t i = 0; i < min(segment.getSize(), partition_size); i++) {
+            buffer[i] = segment[i];
+        }
+        fft->fft(buffer, getFilter(in, out, index));
+    }
+    /**
+     * Convolve one partition worth of samples per channel.
+     * @param in, out arrays of 2 channels, partition_size samples each
+     */
+    void process(float** in, float** out) {
+        current = current == 0 ? num_partitions - 1 : current - 1;
+        for (size_t ch = 0; ch < 2; ch++) {
+            // Sliding window of the last two input partitions
+            float* window = inputs[ch].getData();
+            memmove(window, window + partition_size, partition_size * sizeof(float));
+            memcpy(window + partition_size, in[ch], partition_size * sizeof(float));
+            fft->fft(inputs[ch], getSpectrum(ch, current));
+        }
+        for (size_t ch = 0; ch < 2; ch++) {
+            accumulator.clear();
+            for (size_t src = 0; src < 2; src++) {
+                for (size_t k = 0; k < num_partitions; k++) {
+                    size_t slot = current + k;
+                    if (slot >= num_partitions)
+                        slot -= num_partitions;
+                    multiplyAccumulate(getSpectrum(src, slot), getFilter(src, ch, k));
+                }
+            }
+            fft->ifft(accumulator.getData(), buffer);
+            memcpy(out[ch], buffer.getData() + partition_size,
+                partition_size * sizeof(float));
+        }
+    }
+    void clear() {
+        memset(fdl, 0, 2 * num_partitions * partition_size * sizeof(ComplexFloat));
+        inputs[0].clear();
+        inputs[1].clear();
+    }
+    void clearFilters() {
+        memset(filters, 0, 4 * num_partitions * partition_size * sizeof(ComplexFloat));
+    }
+    size_t getPartitionSize() const {
+        return partition_size;
+    }
+    size_t getNumPartitions() const {
+        return num_partitions;
+    }
+
+    static ConvolutionStage* create(size_t partition_size, size_t num_partitions) {
+        FloatArray inputs[2] = {
+            FloatArray::create(partition_size * 2),
+            FloatArray::create(partition_size * 2),
+        };
+        return new ConvolutionStage(
+            RealFFT::create(partition_size * 2),
+            partition_size, num_partitions,
+            new ComplexFloat[4 * num_partitions * partition_size],
+            new ComplexFloat[2 * num_partitions * partition_size], inputs,
+            ComplexFloatArray::create(partition_size),
+            FloatArray::create(partition_size * 2));
+    }
+    static void destroy(ConvolutionStage* stage) {
+        RealFFT::destroy(stage->fft);
+        delete[] stage->filters;
+        delete[] stage->fdl;
+        FloatArray::destroy(stage->inputs[0]);
+        FloatArray::destroy(stage->inputs[1]);
+        ComplexFloatArray::destroy(stage->accumulator);
+        FloatArray::destroy(stage->buffer);
+        delete stage;
+    }
+
+protected:
+    RealFFT* fft;
+    size_t partition_size;
+    size_t num_partitions;
+    ComplexFloat* filters;
+    ComplexFloat* fdl;
+    FloatArray inputs[2];
+    ComplexFloatArray accumulator;
+    FloatArray buffer;
+    size_t current;
+
+    ComplexFloat* getFilter(size_t in, size_t out, size_t index) {
+        return filters + ((in * 2 + out) * num_partitions + index) * partition_size;
+    }
+    ComplexFloat* getSpectrum(size_t ch, size_t slot) {
+        return fdl + (ch * num_partitions + slot) * partition_size;
+    }
+    inline void multiplyAccumulate(const ComplexFloat* x, const ComplexFloat* h) {
+        ComplexFloat* acc = accumulator.getData();
+        acc[0].re += x[0].re * h[0].re;
+        acc[0].im += x[0].im * h[0].im;
+        for (size_t i = 1; i < partition_size; i++) {
+            acc[i].re += x[i].re * h[i].re - x[i].im * h[i].im;
+            acc[i].im += x[i].re * h[i].im + x[i].im * h[i].re;
+        }
+    }
+};
+
+/**
+ * Stereo convolution engine with optional non-uniform partitioning.
+ *
+ * With a single stage every partition is one block long, which keeps the
+ * cost per block constant but makes long responses expensive. With two
+ * stages the first tail_partition_size samples are handled by block-sized
+ * partitions and the rest of the response by partitions of
+ * tail_partition_size, computed once every tail_partition_size / block_size
+ * blocks. Both variants have no latency beyond the host block.
+ **/
+class PartitionedConvolution : public MultiSignalProcessor {
+public:
+    PartitionedConvolution(size_t block_size, size_t ir_length,
+        ConvolutionStage* head, ConvolutionStage* tail, AudioBuffer* tail_input,
+        AudioBuffer* tail_output, AudioBuffer* staging)
+        : block_size(block_size)
+        , ir_length(ir_length)
+        , head(head)
+        , tail(tail)
+        , tail_input(tail_input)
+        , tail_output(tail_output)
+        , staging(staging)
+        , tail_position(0) {
+    }
+    void process(AudioBuffer& input, AudioBuffer& output) override {
+        ASSERT(input.getSize() == block_size, "Block size must match partition size");
+        float* in[2] = {
+            input.getSamples(0).getData(), input.getSamples(1).getData()};
+        float* out[2] = {
+            output.getSamples(0).getData(), output.getSamples(1).getData()};
+        if (tail == nullptr) {
+            head->process(in, out);
+            return;
+        }
+        float* tail_in[2];
+        float* tail_out[2];
+        for (size_t ch = 0; ch < 2; ch++) {
+            tail_in[ch] = tail_input->getSamples(ch).getData();
+            tail_out[ch] = tail_output->getSamples(ch).getData();
+            memcpy(tail_in[ch] + tail_position, in[ch], block_size * sizeof(float));
+        }
+        head->process(in, out);
+        for (size_t ch = 0; ch < 2; ch++) {
+            for (size_t i = 0; i < block_size; i++) {
+                out[ch][i] += tail_out[ch][tail_position + i];
+            }
+        }
+        tail_position += block_size;
+        if (tail_position == tail->getPartitionSize()) {
+            // Output of the tail stage is delayed by one of its partitions,
+            // which is exactly where its part of the response starts.
+            tail->process(tail_in, tail_out);
+            tail_position = 0;
+        }
+    }
+    /**
+     * Load a block_size long piece of the impulse response for an
+     * input/output pair. Segments must be loaded one input at a time, in
+     * order of their offset; tail partitions are transformed as soon as they
+     * are complete.
+     */
+    void setSegment(size_t in, size_t out, size_t offset, FloatArray segment) {
+        size_t head_length = head->getNumPartitions() * block_size;
+        if (offset < head_length) {
+            head->setPartition(in, out, offset / block_size, segment);
+            return;
+        }
+        if (tail == nullptr)
+            return;
+        size_t tail_size = tail->getPartitionSize();
+        size_t tail_offset = offset - head_length;
+        FloatArray partition = staging->getSamples(out);
+        partition.subArray(tail_offset % tail_size, block_size).copyFrom(segment);
+        if ((tail_offset + block_size) % tail_size == 0)
+            tail->setPartition(in, out, tail_offset / tail_size, partition);
+    }
+    void clear() {
+        head->clear();
+        if (tail != nullptr) {
+            tail->clear();
+            tail_input->clear();
+            tail_output->clear();
+        }
+        tail_position = 0;
+    }
+    size_t getLength() const {
+        return ir_length;
+    }
+    size_t getBlockSize() const {
+        return block_size;
+    }
+
+    /**
+     * @param block_size host block size, must be a power of two
+     * @param ir_length impulse response length, rounded up to whole partitions
+     * @param tail_partition_size partition size for the tail, 0 for uniform
+     * partitioning. Must be a power of two multiple of block_size.
+     */
+    static PartitionedConvolution* create(
+        size_t block_size, size_t ir_length, size_t tail_partition_size = 0) {
+        if (tail_partition_size <= block_size ||
+            ir_length <= tail_partition_size * 2) {
+            size_t partitions = (ir_length + block_size - 1) / block_size;
+            return new PartitionedConvolution(block_size, partitions * block_size,
+                ConvolutionStage::create(block_size, partitions), nullptr,
+                nullptr, nullptr, nullptr);
+        }
+        size_t head_partitions = tail_partition_size / block_size;
+        size_t tail_partitions =
+            (ir_length - tail_partition_size + tail_partition_size - 1) /
+            tail_partition_size;
+        return new PartitionedConvolution(block_size,
+            tail_partition_size * (tail_partitions + 1),
+            ConvolutionStage::create(block_size, head_partitions),
+            ConvolutionStage::create(tail_partition_size, tail_partitions),
+            AudioBuffer::create(2, tail_partition_size),
+            AudioBuffer::create(2, tail_partition_size),
+            AudioBuffer::create(2, tail_partition_size));
+    }
+    static void destroy(PartitionedConvolution* convolution) {
+        ConvolutionStage::destroy(convolution->head);
+        if (convolution->tail != nullptr) {
+            ConvolutionStage::destroy(convolution->tail);
+            AudioBuffer::destroy(convolution->tail_input);
+            AudioBuffer::destroy(convolution->tail_output);
+            AudioBuffer::destroy(convolution->staging);
+        }
+        delete convolution;
+    }
+
+protected:
+    size_t block_size;
+    size_t ir_length;
+    ConvolutionStage* head;
+    ConvolutionStage* tail;
+    AudioBuffer* tail_input;
+    AudioBuffer* tail_output;
+    AudioBuffer* staging;
+    size_t tail_position;
+};
+
+#endif
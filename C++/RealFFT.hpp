@@ -0,0 +1,91 @@
+#ifndef __REAL_FFT_HPP__
+#define __REAL_FFT_HPP__
+
+#include "OpenWareLibrary.h"
+
+/**
+ * Real FFT with the same spectrum layout on every platform: n / 2 complex
+ * bins, where bin 0 holds DC in re and Nyquist in im.
+ *
+ * On the device FastFourierTransform is the CMSIS real FFT, which uses this
+ * layout already but overwrites its input, so input is copied first. The
+ * host library does a complex transform into n bins instead, so spectra
+ * are packed and unpacked around it. Inverse transforms are scaled by 1 / n
+ * on both.
+ **/
+class RealFFT {
+public:
+    RealFFT(FastFourierTransform* transform, size_t size, FloatArray scratch,
+        ComplexFloatArray spectrum)
+        : transform(transform)
+        , size(size)
+        , scratch(scratch)
+        , spectrum(spectrum) {
+    }
+    /**
+     * @param input size samples, left unchanged
+     * @param output size / 2 packed bins
+     */
+    void fft(FloatArray input, ComplexFloat* output) {
+#ifdef ARM_CORTEX
+        scratch.copyFrom(input.subArray(0, size));
+        transform->fft(scratch, ComplexFloatArray(output, size / 2));
+#else
+        transform->fft(input, spectrum);
+        output[0].re = spectrum[0].re;
+        output[0].im = spectrum[size / 2].re;
+        memcpy(output + 1, spectrum.getData() + 1, (size / 2 - 1) * sizeof(ComplexFloat));
+#endif
+    }
+    /**
+     * @param input size / 2 packed bins, may be overwritten
+     * @param output size samples
+     */
+    void ifft(ComplexFloat* input, FloatArray output) {
+#ifdef ARM_CORTEX
+        transform->ifft(ComplexFloatArray(input, size / 2), output);
+#else
+        // Rebuild the full, conjugate symmetric spectrum
+        ComplexFloat* bins = spectrum.getData();
+        bins[0].re = input[0].re;
+        bins[0].im = 0;
+        bins[size / 2].re = input[0].im;
+        bins[size / 2].im = 0;
+        for (size_t k = 1; k < size / 2; k++) {
+            bins[k] = input[k];
+            bins[size - k].re = input[k].re;
+            bins[size - k].im = -input[k].im;
+        }
+        transform->ifft(spectrum, output);
+#endif
+    }
+    size_t getSize() const {
+        return size;
+    }
+    static RealFFT* create(size_t size) {
+#ifdef ARM_CORTEX
+        return new RealFFT(FastFourierTransform::create(size), size,
+            FloatArray::create(size), ComplexFloatArray());
+#else
+        return new RealFFT(FastFourierTransform::create(size), size, FloatArray(),
+            ComplexFloatArray::create(size));
+#endif
+    }
+    static void destroy(RealFFT* fft) {
+        FastFourierTransform::destroy(fft->transform);
+#ifdef ARM_CORTEX
+        FloatArray::destroy(fft->scratch);
+#else
+        ComplexFloatArray::destroy(fft->spectrum);
+#endif
+        delete fft;
+    }
+
+private:
+    FastFourierTransform* transform;
+    size_t size;
+    FloatArray scratch;
+    ComplexFloatArray spectrum;
+};
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef __SATURATOR_BANK_HPP__
+#define __SATURATOR_BANK_HPP__
+
+#include "Nonlinearity.hpp"
+
+enum SaturatorCurve {
+    CURVE_HARD_CLIP,
+    CURVE_CUBIC,
+    CURVE_SECOND_ORDER,
+    CURVE_THIRD_ORDER,
+    CURVE_FOURTH_ORDER,
+    CURVE_ALGEBRAIC,
+    CURVE_TANH,
+    CURVE_ARCTAN,
+    CURVE_SINE,
+    CURVE_QUADRATIC_SINE,
+    CURVE_CUBIC_SINE,
+    CURVE_RECIPROCAL,
+    NUM_SATURATOR_CURVES,
+};
+
+const char* saturator_curve_names[] = {
+    "HardClip",
+    "Cubic",
+    "2ndOrder",
+    "3rdOrder",
+    "4thOrder",
+    "Algebraic",
+    "Tanh",
+    "Arctan",
+    "Sine",
+    "QuadSine",
+    "CubicSine",
+    "Reciprocal",
+};
+
+/**
+ * Stereo saturator with a curve that can be changed at runtime.
+ *
+ * Every curve is available in aliasing and antialiased form. The curve is
+ * resolved once per block by a switch that calls a fully inlined kernel for
+ * that curve, so there is no per-sample dispatch. On a change both the old
+ * and the new curve run for FADE_LENGTH samples and are crossfaded. A
+ * change that comes in during a fade waits for it to finish, only the
+ * latest one is kept.
+ *
+ * The input history is shared by all curves. The antiderivative history is
+ * recomputed for the new curve on a switch, so that its first output sample
+ * is already correct.
+ **/
+class SaturatorBank : public MultiSignalProcessor {
+public:
+    static constexpr size_t FADE_LENGTH = 256;
+
+    struct ShaperState {
+        float xn1[2];
+        float Fn1[2];
+        bool fresh;
+    };
+
+    SaturatorBank(FloatArray fade_buffer)
+        : fade_buffer(fade_buffer)
+        , curve(CURVE_THIRD_ORDER)
+        , antialiased(true)
+        , old_curve(CURVE_THIRD_ORDER)
+        , old_antialiased(true)
+        , next_curve(CURVE_THIRD_ORDER)
+        , next_antialiased(true)
+        , active(0)
+        , fade_position(FADE_LENGTH) {
+        reset();
+    }
+    void process(AudioBuffer& input, AudioBuffer& output) override {
+        size_t size = input.getSize();
+        const float* in[2] = {
+            input.getSamples(0).getData(), input.getSamples(1).getData()};
+        float* out[2] = {
+            output.getSamples(0).getData(), output.getSamples(1).getData()};
+        if (fade_position >= FADE_LENGTH &&
+            (next_curve != curve || next_antialiased != antialiased))
+            startFade();
+        if (fade_position < FADE_LENGTH) {
+            // Old curve into the fade buffer, new curve into output
+            float* old_out[2] = {
+                fade_buffer.getData(), fade_buffer.getData() + size};
+            dispatch(old_curve, old_antialiased, in, old_out, size, states[active ^ 1]);
+            dispatch(curve, antialiased, in, out, size, states[active]);
+            for (size_t ch = 0; ch < 2; ch++) {
+                size_t position = fade_position;
+                for (size_t i = 0; i < size; i++) {
+                    float mix = position < FADE_LENGTH ?
+                        float(position++) / FADE_LENGTH : 1.0f;
+                    out[ch][i] = old_out[ch][i] + (out[ch][i] - old_out[ch][i]) * mix;
+                }
+            }
+            fade_position += size;
+        }
+        else {
+            dispatch(curve, antialiased, in, out, size, states[active]);
+        }
+    }
+    /**
+     * Switch curves, with a crossfade that starts on the next block. Jumping
+     * to another curve halfway through a fade would click.
+     */
+    void setCurve(SaturatorCurve curve, bool antialiased) {
+        next_curve = curve;
+        next_antialiased = antialiased;
+    }
+    /**
+     * Select by index: antialiased curves first, then the aliasing ones
+     */
+    void setCurve(size_t index) {
+        index = min(index, size_t(NUM_SATURATOR_CURVES * 2 - 1));
+        setCurve(SaturatorCurve(index % NUM_SATURATOR_CURVES),
+            index < NUM_SATURATOR_CURVES);
+    }
+    SaturatorCurve getCurve() const {
+        return curve;
+    }
+    bool isAntialiased() const {
+        return antialiased;
+    }
+    /**
+     * Clear all state, a requested curve applies straight away
+     */
+    void reset() {
+        curve = next_curve;
+        antialiased = next_antialiased;
+        for (size_t slot = 0; slot < 2; slot++) {
+            states[slot] = {{0, 0}, {0, 0}, true};
+        }
+        fade_position = FADE_LENGTH;
+    }
+    static SaturatorBank* create(size_t block_size) {
+        return new SaturatorBank(FloatArray::create(block_size * 2));
+    }
+    static void destroy(SaturatorBank* bank) {
+        FloatArray::destroy(bank->fade_buffer);
+        delete bank;
+    }
+
+protected:
+    FloatArray fade_buffer;
+    SaturatorCurve curve;
+    bool antialiased;
+    SaturatorCurve old_curve;
+    bool old_antialiased;
+    SaturatorCurve next_curve; // Requested, applied once no fade is running
+    bool next_antialiased;
+    ShaperState states[2]; // Current and previous curve
+    size_t active;
+    size_t fade_position;
+
+    void startFade() {
+        old_curve = curve;
+        old_antialiased = antialiased;
+        curve = next_curve;
+        antialiased = next_antialiased;
+        active ^= 1;
+        for (size_t ch = 0; ch < 2; ch++) {
+            states[active].xn1[ch] = states[active ^ 1].xn1[ch];
+        }
+        states[active].fresh = true;
+        fade_position = 0;
+    }
+    template <typename Function>
+    static void processKernel(bool antialiased, const float* const* in,
+        float* const* out, size_t size, ShaperState& state) {
+        if (antialiased) {
+            if (state.fresh) {
+                for (size_t ch = 0; ch < 2; ch++) {
+                    state.Fn1[ch] = Function::getAntiderivative1(state.xn1[ch]);
+                }
+            }
+            using Shaper = AntialiasedWaveshaperTemplate<Function>;
+            for (size_t ch = 0; ch < 2; ch++) {
+                for (size_t i = 0; i < size; i++) {
+                    float x = in[ch][i];
+                    out[ch][i] = Shaper::antialiasedSample(x,
+                        Function::getAntiderivative1(x), state.xn1[ch], state.Fn1[ch]);
+                }
+            }
+        }
+        else {
+            for (size_t ch = 0; ch < 2; ch++) {
+                for (size_t i = 0; i < size; i++) {
+                    out[ch][i] = Function::getSample(in[ch][i]);
+                }
+                if (size > 0)
+                    state.xn1[ch] = in[ch][size - 1];
+            }
+        }
+        state.fresh = !antialiased;
+    }
+    static void dispatch(SaturatorCurve curve, bool antialiased,
+        const float* const* in, float* const* out, size_t size, ShaperState& state) {
+        switch (curve) {
+        case CURVE_HARD_CLIP:
+            processKernel<HardClip>(antialiased, in, out, size, state);
+            break;
+        case CURVE_CUBIC:
+            processKernel<CubicSaturator>(antialiased, in, out, size, state);
+            break;
+        case CURVE_SECOND_ORDER:
+            processKernel<SecondOrderPolynomial>(antialiased, in, out, size, state);
+            break;
+        case CURVE_THIRD_ORDER:
+            processKernel<ThirdOrderPolynomial>(antialiased, in, out, size, state);
+            break;
+        case CURVE_FOURTH_ORDER:
+            processKernel<FourthOrderPolynomial>(antialiased, in, out, size, state);
+            break;
+        case CURVE_ALGEBRAIC:
+            processKernel<AlgebraicSaturator>(antialiased, in, out, size, state);
+            break;
+        case CURVE_TANH:
+            processKernel<TanhSaturator>(antialiased, in, out, size, state);
+            break;
+        case CURVE_ARCTAN:
+            processKernel<ArctanSaturator>(antialiased, in, out, size, state);
+            break;
+        case CURVE_SINE:
+            processKernel<SineSaturator>(antialiased, in, out, size, state);
+            break;
+        case CURVE_QUADRATIC_SINE:
+            processKernel<QuadraticSineSaturator>(antialiased, in, out, size, state);
+            break;
+        case CURVE_CUBIC_SINE:
+            processKernel<CubicSineSaturator>(antialiased, in, out, size, state);
+            break;
+        case CURVE_RECIPROCAL:
+            processKernel<ReciprocalSaturator>(antialiased, in, out, size, state);
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+#endif
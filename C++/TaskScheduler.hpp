@@ -0,0 +1,107 @@
+#ifndef __TASK_SCHEDULER_HPP__
+#define __TASK_SCHEDULER_HPP__
+
+#include "OpenWareLibrary.h"
+
+#define SCHEDULER_MAX_TASKS 8
+
+/**
+ * Work that is too heavy for a single audio block, split into steps that
+ * resume where the previous one stopped
+ **/
+class BackgroundTask {
+public:
+    virtual ~BackgroundTask() = default;
+    /**
+     * Do a small, bounded slice of work. Idle tasks return straight away.
+     * @return true if there is more work left
+     */
+    virtual bool step() = 0;
+};
+
+/**
+ * Cooperative scheduler that runs background tasks in the time left over
+ * after audio processing.
+ *
+ * Tasks stay registered and are stepped round robin until they are all
+ * idle or the budget for the block is used up. Every step is timed, and a
+ * task only gets another step if its recent slowest step still fits
+ * before the budget runs out, so background work doesn't push a block
+ * past its deadline.
+ *
+ * The estimate is lowered a little on every step and every skip. A single
+ * slow step then doesn't hold a task back for long, and a step that is
+ * slower than the whole budget still runs eventually.
+ **/
+class TaskScheduler {
+public:
+    TaskScheduler()
+        : num_tasks(0)
+        , next(0) {
+    }
+    bool add(BackgroundTask* task) {
+        if (num_tasks == SCHEDULER_MAX_TASKS)
+            return false;
+        Entry& entry = tasks[num_tasks++];
+        entry.task = task;
+        entry.cost = 0;
+        return true;
+    }
+    /**
+     * Step tasks until they are idle or the budget is spent
+     * @param clock callable returning a free running uint32_t counter
+     * @param start clock value at the start of the block
+     * @param budget clock ticks after start that may be used
+     * @return number of steps run
+     */
+    template <typename Clock>
+    size_t run(Clock clock, uint32_t start, uint32_t budget) {
+        size_t steps = 0;
+        uint32_t skipped = 0;
+        bool pending = true;
+        while (pending) {
+            pending = false;
+            for (size_t n = 0; n < num_tasks; n++) {
+                size_t index = next;
+                Entry& entry = tasks[index];
+                next = (next + 1) % num_tasks;
+                if (skipped & (1u << index))
+                    continue;
+                uint32_t now = clock();
+                uint32_t used = now - start;
+                if (used >= budget) {
+                    next = index; // First in line next block
+                    return steps;
+                }
+                if (entry.cost > budget - used) {
+                    // Won't fit for the rest of this block either
+                    entry.cost -= entry.cost >> 4;
+                    skipped |= 1u << index;
+                    continue;
+                }
+                pending |= entry.task->step();
+                entry.cost = max(entry.cost - (entry.cost >> 4), clock() - now);
+                steps++;
+            }
+        }
+        return steps;
+    }
+    static TaskScheduler* create() {
+        return new TaskScheduler();
+    }
+    static void destroy(TaskScheduler* scheduler) {
+        delete scheduler;
+    }
+
+private:
+    struct Entry {
+        BackgroundTask* task;
+        uint32_t cost;
+    };
+
+    Entry tasks[SCHEDULER_MAX_TASKS];
+    size_t num_tasks;
+    size_t next;
+};
+
+#endif
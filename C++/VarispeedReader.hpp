@@ -0,0 +1,173 @@
+#ifndef __VARISPEED_READER_HPP__
+#define __VARISPEED_READER_HPP__
+
+#include "OpenWareLibrary.h"
+
+#define VARISPEED_TAPS 16
+#define VARISPEED_PHASES 64
+#define VARISPEED_BANKS 4
+
+/**
+ * Fractional-rate stereo reader for a loop buffer.
+ *
+ * Samples are interpolated with a 16 tap windowed sinc, taken from a
+ * polyphase table built once in create(). Adjacent phases are blended
+ * linearly, so 64 phases are enough. Below unity speed the kernel is the
+ * anti-imaging filter, above it aliasing has to be removed, so there is a
+ * bank of kernels with lower cutoffs and the one for the current speed is
+ * picked per block.
+ *
+ * The blended kernel is shared by both channels, and away from the loop
+ * point every tap loop runs over 16 contiguous samples.
+ **/
+class VarispeedReader {
+public:
+    static constexpr float MAX_SPEED = 2.0f;
+
+    VarispeedReader(float* kernels)
+        : kernels(kernels)
+        , index(0)
+        , fraction(0) {
+    }
+    /**
+     * Move the read head, position is in samples
+     */
+    void setPosition(float position) {
+        index = size_t(position);
+        fraction = position - index;
+    }
+    float getPosition() const {
+        return index + fraction;
+    }
+    /**
+     * Read size samples per channel from a loop of length samples, advancing
+     * by increment samples per output sample. Negative increments play
+     * backwards, the magnitude is limited to MAX_SPEED.
+     */
+    void process(float* const* buf, size_t length, float increment,
+        float* const* out, size_t size) {
+        if (length < VARISPEED_TAPS) {
+            for (size_t ch = 0; ch < 2; ch++) {
+                memset(out[ch], 0, size * sizeof(float));
+            }
+            return;
+        }
+        increment = max(-MAX_SPEED, min(increment, MAX_SPEED));
+        const float* bank = kernels + getBank(fabsf(increment)) *
+            (VARISPEED_PHASES + 1) * VARISPEED_TAPS;
+        index %= length;
+
+        const size_t before = VARISPEED_TAPS / 2 - 1;
+        float* left = out[0];
+        float* right = out[1];
+        for (size_t i = 0; i < size; i++) {
+            // Blend the two nearest phases, taps run from index - 7 to
+            // index + 8
+            float phase = fraction * VARISPEED_PHASES;
+            int p = min(int(phase), VARISPEED_PHASES - 1);
+            float blend = phase - p;
+            const float* k0 = bank + p * VARISPEED_TAPS;
+            const float* k1 = k0 + VARISPEED_TAPS;
+            float c[VARISPEED_TAPS];
+            for (size_t t = 0; t < VARISPEED_TAPS; t++) {
+                c[t] = k0[t] + (k1[t] - k0[t]) * blend;
+            }
+            size_t first = index + length - before;
+            if (first >= length && first - length + VARISPEED_TAPS <= length) {
+                left[i] = dot(c, buf[0] + first - length);
+                right[i] = dot(c, buf[1] + first - length);
+            }
+            else {
+                // Around the loop point
+                float x[2][VARISPEED_TAPS];
+                for (size_t t = 0; t < VARISPEED_TAPS; t++) {
+                    size_t pos = (first + t) % length;
+                    x[0][t] = buf[0][pos];
+                    x[1][t] = buf[1][pos];
+                }
+                left[i] = dot(c, x[0]);
+                right[i] = dot(c, x[1]);
+            }
+
+            // fraction + increment is above -MAX_SPEED, so truncating the
+            // offset value is a floor
+            fraction += increment;
+            int step = int(fraction + MAX_SPEED) - int(MAX_SPEED);
+            fraction -= step;
+            long next = long(index) + step;
+            if (next < 0)
+                next += length;
+            else if (next >= long(length))
+                next -= length;
+            index = next;
+        }
+    }
+
+    static VarispeedReader* create() {
+        float* kernels =
+            new float[VARISPEED_BANKS * (VARISPEED_PHASES + 1) * VARISPEED_TAPS];
+        for (size_t b = 0; b < VARISPEED_BANKS; b++) {
+            // Cutoff below Nyquist at the fastest speed of this bank
+            float cutoff = 0.9f / getBankSpeed(b);
+            float* bank = kernels + b * (VARISPEED_PHASES + 1) * VARISPEED_TAPS;
+            for (size_t p = 0; p <= VARISPEED_PHASES; p++) {
+                float* k = bank + p * VARISPEED_TAPS;
+                float frac = float(p) / VARISPEED_PHASES;
+                float sum = 0;
+                for (size_t t = 0; t < VARISPEED_TAPS; t++) {
+                    float x = float(t) - (VARISPEED_TAPS / 2 - 1) - frac;
+                    float w = (x + VARISPEED_TAPS / 2) / VARISPEED_TAPS;
+                    float window = w <= 0 || w >= 1 ? 0 :
+                        0.42f - 0.5f * cosf(2 * M_PI * w) + 0.08f * cosf(4 * M_PI * w);
+                    float sinc = fabsf(x) < 1e-6f ? 1.0f :
+                        sinf(M_PI * cutoff * x) / (M_PI * cutoff * x);
+                    k[t] = sinc * window;
+                    sum += k[t];
+                }
+                // Unity gain at DC for every phase
+                for (size_t t = 0; t < VARISPEED_TAPS; t++) {
+                    k[t] /= sum;
+                }
+            }
+        }
+        return new VarispeedReader(kernels);
+    }
+    static void destroy(VarispeedReader* reader) {
+        delete[] reader->kernels;
+        delete reader;
+    }
+
+private:
+    float* kernels;
+    size_t index;
+    float fraction;
+
+    /**
+     * Four partial sums, a single accumulator would serialize on the adder
+     */
+    static inline float dot(const float* c, const float* x) {
+        float sum[4] = {0, 0, 0, 0};
+        for (size_t t = 0; t < VARISPEED_TAPS; t += 4) {
+            for (size_t j = 0; j < 4; j++) {
+                sum[j] += c[t + j] * x[t + j];
+            }
+        }
+        return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    }
+
+    /**
+     * Fastest speed handled by a bank: 1, 1.33, 1.66, 2
+     */
+    static float getBankSpeed(size_t bank) {
+        return 1.0f + bank * (MAX_SPEED - 1.0f) / (VARISPEED_BANKS - 1);
+    }
+    static size_t getBank(float speed) {
+        for (size_t b = 0; b < VARISPEED_BANKS - 1; b++) {
+            if (speed <= getBankSpeed(b))
+                return b;
+        }
+        return VARISPEED_BANKS - 1;
+    }
+};
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef __RENDER_CHAIN_HPP__
+#define __RENDER_CHAIN_HPP__
+
+/**
+ * Offline version of the FrippertronicsPatch signal chain: input gain,
+ * Dattorro reverb and a saturator per channel. The reverb can be swapped
+ * for an FDN, to compare the two on real material. The looper is left out
+ * because it is driven by button presses, which have no meaning when
+ * printing stems. Parameters are fixed for the whole render, so there is
+ * no smoothing, and with freeze_length set the reverb switches to its
+ * convolution fast path as soon as the impulse response is captured.
+ **/
+
+#include "OpenWareLibrary.h"
+#include "DattorroStereoReverb.hpp"
+#include "BatchedDattorroReverb.hpp"
+#include "FdnReverb.hpp"
+#include "FreezableReverb.hpp"
+#include "Nonlinearity.hpp"
+
+enum RenderReverb {
+    RENDER_DATTORRO,
+    RENDER_FDN4,
+    RENDER_FDN8,
+};
+
+struct RenderSettings {
+    float gain = 1.0;
+    float amount = 0.75;
+    float diffusion = 0.7;
+    float damping = 0.7;
+    bool saturate = true;
+    bool modulate = true; // Reverb LFOs, without them the tank is time invariant
+    RenderReverb reverb = RENDER_DATTORRO;
+    size_t freeze_length = 0; // Impulse response length, 0 renders with the tank
+    size_t freeze_partition = 8192; // Tail partition size for freeze mode
+};
+
+class RenderChain {
+public:
+    using Saturator = AntialiasedThirdOrderPolynomial;
+    using DestroyReverb = void (*)(MultiSignalProcessor*);
+
+    RenderChain(MultiSignalProcessor* reverb, DestroyReverb destroy_reverb,
+        Saturator* saturator_left, Saturator* saturator_right,
+        const RenderSettings& settings)
+        : reverb(reverb)
+        , destroy_reverb(destroy_reverb)
+        , settings(settings) {
+        saturators[0] = saturator_left;
+        saturators[1] = saturator_right;
+    }
+    void process(AudioBuffer& buffer) {
+        buffer.multiply(settings.gain * 0.5);
+        reverb->process(buffer, buffer);
+        if (settings.saturate) {
+            for (int i = 0; i < 2; i++) {
+                FloatArray t = buffer.getSamples(i);
+                saturators[i]->process(t, t);
+            }
+        }
+    }
+    static RenderChain* create(size_t block_size, float sr,
+        const RenderSettings& settings) {
+        switch (settings.reverb) {
+        case RENDER_FDN4:
+            return create<FdnReverb<4>>(block_size, sr, settings, fdn4_delays);
+        case RENDER_FDN8:
+            return create<FdnReverb<8>>(block_size, sr, settings, fdn8_delays);
+        default:
+            return create<DattorroStereoReverb<>>(block_size, sr, settings, rings_delays);
+        }
+    }
+    static void destroy(RenderChain* chain) {
+        chain->destroy_reverb(chain->reverb);
+        Saturator::destroy(chain->saturators[0]);
+        Saturator::destroy(chain->saturators[1]);
+        delete chain;
+    }
+
+private:
+    MultiSignalProcessor* reverb;
+    DestroyReverb destroy_reverb;
+    Saturator* saturators[2];
+    RenderSettings settings;
+
+    template <typename Reverb>
+    static RenderChain* create(size_t block_size, float sr,
+        const RenderSettings& settings, const size_t* delay_lengths) {
+        using FrozenReverb = FreezableReverb<Reverb>;
+        MultiSignalProcessor* reverb;
+        DestroyReverb destroy_reverb;
+        if (settings.freeze_length == 0) {
+            Reverb* tank = Reverb::create(block_size, sr, delay_lengths);
+            setup(tank, settings);
+            reverb = tank;
+            destroy_reverb = [](MultiSignalProcessor* reverb) {
+                Reverb::destroy(static_cast<Reverb*>(reverb));
+            };
+        }
+        else {
+            FrozenReverb* frozen = FrozenReverb::create(block_size, sr,
+                settings.freeze_length, settings.freeze_partition, delay_lengths);
+            setup(frozen, settings);
+            reverb = frozen;
+            destroy_reverb = [](MultiSignalProcessor* reverb) {
+                FrozenReverb::destroy(static_cast<FrozenReverb*>(reverb));
+            };
+        }
+        return new RenderChain(reverb, destroy_reverb, Saturator::create(),
+            Saturator::create(), settings);
+    }
+    template <typename T>
+    static void setup(T* reverb, const RenderSettings& settings) {
+        reverb->setModulation(4460, settings.modulate ? 40 : 0, 6261,
+            settings.modulate ? 50 : 0);
+        reverb->setAmount(settings.amount);
+        reverb->setDecay(0.35 + settings.amount * 0.63);
+        reverb->setDiffusion(settings.diffusion);
+        reverb->setDamping(settings.damping);
+    }
+};
+
+/**
+ * RenderChain with the Dattorro reverb for several stereo files at once.
+ * Every file is a lane of a BatchedDattorroReverb, which processes them
+ * together. Lanes share the sample rate and settings, and there is no
+ * freeze mode.
+ **/
+template <size_t lanes>
+class BatchedRenderChain {
+public:
+    using Reverb = BatchedDattorroReverb<lanes>;
+    using Saturator = RenderChain::Saturator;
+
+    BatchedRenderChain(Reverb* reverb, AudioBuffer* buffer, Saturator** saturators,
+        const RenderSettings& settings)
+        : reverb(reverb)
+        , buffer(buffer)
+        , settings(settings) {
+        for (size_t ch = 0; ch < lanes * 2; ch++) {
+            this->saturators[ch] = saturators[ch];
+        }
+    }
+    /**
+     * @param inputs one stereo buffer per lane, processed in place
+     */
+    void process(AudioBuffer** inputs) {
+        for (size_t ch = 0; ch < lanes * 2; ch++) {
+            buffer->getSamples(ch).copyFrom(inputs[ch / 2]->getSamples(ch & 1));
+        }
+        buffer->multiply(settings.gain * 0.5);
+        reverb->process(*buffer, *buffer);
+        for (size_t ch = 0; ch < lanes * 2; ch++) {
+            FloatArray t = buffer->getSamples(ch);
+            if (settings.saturate)
+                saturators[ch]->process(t, t);
+            inputs[ch / 2]->getSamples(ch & 1).copyFrom(t);
+        }
+    }
+    static BatchedRenderChain* create(size_t block_size, float sr,
+        const RenderSettings& settings) {
+        Reverb* reverb = Reverb::create(block_size, sr, rings_delays);
+        for (size_t lane = 0; lane < lanes; lane++) {
+            reverb->setModulation(lane, 4460, settings.modulate ? 40 : 0, 6261,
+                settings.modulate ? 50 : 0);
+            reverb->setAmount(lane, settings.amount);
+            reverb->setDecay(lane, 0.35 + settings.amount * 0.63);
+            reverb->setDiffusion(lane, settings.diffusion);
+            reverb->setDamping(lane, settings.damping);
+        }
+        Saturator* saturators[lanes * 2];
+        for (size_t ch = 0; ch < lanes * 2; ch++) {
+            saturators[ch] = Saturator::create();
+        }
+        return new BatchedRenderChain(reverb,
+            AudioBuffer::create(lanes * 2, block_size), saturators, settings);
+    }
+    static void destroy(BatchedRenderChain* chain) {
+        Reverb::destroy(chain->reverb);
+        AudioBuffer::destroy(chain->buffer);
+        for (size_t ch = 0; ch < lanes * 2; ch++) {
+            Saturator::destroy(chain->saturators[ch]);
+        }
+        delete chain;
+    }
+
+private:
+    Reverb* reverb;
+    AudioBuffer* buffer;
+    Saturator* saturators[lanes * 2];
+    RenderSettings settings;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef __SPECTRUM_HPP__
+#define __SPECTRUM_HPP__
+
+/**
+ * Double precision radix-2 FFT for host analysis tools. Accuracy matters
+ * more than speed here, so this doesn't use the library FFT.
+ **/
+
+#include <cmath>
+#include <complex>
+#include <utility>
+#include <vector>
+
+/**
+ * In-place forward transform, size must be a power of two
+ */
+inline void fft(std::vector<std::complex<double>>& x) {
+    size_t n = x.size();
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(x[i], x[j]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        std::complex<double> w = std::polar(1.0, -2 * M_PI / len);
+        for (size_t i = 0; i < n; i += len) {
+            std::complex<double> wn = 1;
+            for (size_t j = 0; j < len / 2; j++) {
+                std::complex<double> a = x[i + j];
+                std::complex<double> b = x[i + j + len / 2] * wn;
+                x[i + j] = a + b;
+                x[i + j + len / 2] = a - b;
+                wn *= w;
+            }
+        }
+    }
+}
+
+/**
+ * Hann windowed magnitude spectrum of size samples starting at data
+ * @return size / 2 magnitudes, DC included
+ */
+inline std::vector<double> magnitudeSpectrum(const float* data, size_t size) {
+    std::vector<std::complex<double>> frame(size);
+    for (size_t i = 0; i < size; i++) {
+        double window = 0.5 - 0.5 * cos(2 * M_PI * i / size);
+        frame[i] = data[i] * window;
+    }
+    fft(frame);
+    std::vector<double> magnitudes(size / 2);
+    for (size_t k = 0; k < size / 2; k++) {
+        magnitudes[k] = std::abs(frame[k]);
+    }
+    return magnitudes;
+}
+
+#endif
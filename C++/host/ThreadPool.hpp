@@ -0,0 +1,123 @@
+#ifndef __THREAD_POOL_HPP__
+#define __THREAD_POOL_HPP__
+
+/**
+ * Minimal work-stealing thread pool for host tools.
+ *
+ * Every worker owns a deque. Tasks are submitted round robin, a worker pops
+ * from the back of its own deque and steals from the front of the others
+ * when it runs dry, so long files don't leave cores idle at the end of a
+ * batch.
+ **/
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t num_threads)
+        : queues(num_threads ? num_threads : 1)
+        , next_queue(0)
+        , pending(0)
+        , running(true) {
+        for (size_t i = 0; i < queues.size(); i++) {
+            workers.emplace_back([this, i] { work(i); });
+        }
+    }
+    ~ThreadPool() {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            running = false;
+        }
+        idle.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    void submit(Task task) {
+        size_t index = next_queue++ % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            pending++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queues[index].mutex);
+            queues[index].tasks.push_back(std::move(task));
+        }
+        idle.notify_one();
+    }
+    /**
+     * Block until every submitted task has finished
+     */
+    void wait() {
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        done.wait(lock, [this] { return pending == 0; });
+    }
+    size_t getSize() const {
+        return queues.size();
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> next_queue;
+    std::mutex idle_mutex;
+    std::condition_variable idle;
+    std::condition_variable done;
+    size_t pending;
+    bool running;
+
+    bool pop(size_t index, Task& task) {
+        Queue& own = queues[index];
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); i++) {
+            Queue& victim = queues[(index + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+    void work(size_t index) {
+        Task task;
+        for (;;) {
+            if (pop(index, task)) {
+                task();
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                if (--pending == 0)
+                    done.notify_all();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(idle_mutex);
+            if (!running)
+                return;
+            // Sleep until something is queued; recheck the deques after waking
+            idle.wait_for(lock, std::chrono::milliseconds(10));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,257 @@
+#ifndef __WAV_FILE_HPP__
+#define __WAV_FILE_HPP__
+
+/**
+ * Memory-mapped WAV reader and writer for host tools.
+ *
+ * Files are never loaded as a whole: samples are converted to and from
+ * AudioBuffer one chunk at a time, and pages that have been consumed are
+ * handed back to the kernel with madvise(MADV_DONTNEED). Supports 16/24 bit
+ * PCM and 32 bit float input, always writes 32 bit float.
+ **/
+
+#include "OpenWareLibrary.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+
+class MappedWavFile {
+public:
+    MappedWavFile()
+        : fd(-1)
+        , map(nullptr)
+        , map_size(0)
+        , data(nullptr)
+        , channels(0)
+        , sample_rate(0)
+        , bits(0)
+        , is_float(false)
+        , frames(0)
+        , position(0) {
+    }
+    ~MappedWavFile() {
+        close();
+    }
+    bool openRead(const char* path) {
+        fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < 44) {
+            close();
+            return false;
+        }
+        map_size = st.st_size;
+        map = (uint8_t*)mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            map = nullptr;
+            close();
+            return false;
+        }
+        madvise(map, map_size, MADV_SEQUENTIAL);
+        if (!parseHeader()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+    /**
+     * Create a float WAV file of a known length. The file is sized up front
+     * and mapped, chunks are then written in place.
+     */
+    bool openWrite(const char* path, uint16_t channels, uint32_t sample_rate,
+        size_t frames) {
+        this->channels = channels;
+        this->sample_rate = sample_rate;
+        this->frames = frames;
+        bits = 32;
+        is_float = true;
+        position = 0;
+        fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        size_t data_size = frames * channels * sizeof(float);
+        map_size = header_size + data_size;
+        if (ftruncate(fd, map_size) != 0) {
+            close();
+            return false;
+        }
+        map = (uint8_t*)mmap(
+            nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            map = nullptr;
+            close();
+            return false;
+        }
+        writeHeader(data_size);
+        data = map + header_size;
+        return true;
+    }
+    void close() {
+        if (map != nullptr)
+            munmap(map, map_size);
+        if (fd >= 0)
+            ::close(fd);
+        map = nullptr;
+        fd = -1;
+    }
+    /**
+     * Read up to buffer.getSize() frames. Missing channels are duplicated
+     * from the last available one, the remainder of a short read is zeroed.
+     * @return number of frames read
+     */
+    size_t read(AudioBuffer& buffer) {
+        size_t count = min(buffer.getSize(), frames - position);
+        size_t frame_bytes = channels * bits / 8;
+        const uint8_t* src = data + position * frame_bytes;
+        for (int ch = 0; ch < buffer.getChannels(); ch++) {
+            float* out = buffer.getSamples(ch).getData();
+            size_t src_ch = min<size_t>(ch, channels - 1);
+            for (size_t i = 0; i < count; i++) {
+                out[i] = decode(src + i * frame_bytes + src_ch * bits / 8);
+            }
+            for (size_t i = count; i < buffer.getSize(); i++) {
+                out[i] = 0;
+            }
+        }
+        release(src, count * frame_bytes);
+        position += count;
+        return count;
+    }
+    /**
+     * Write the first `count` frames of buffer.
+     * @return number of frames written
+     */
+    size_t write(AudioBuffer& buffer, size_t count) {
+        count = min(count, frames - position);
+        float* dst = (float*)data + position * channels;
+        for (size_t ch = 0; ch < channels; ch++) {
+            float* in = buffer.getSamples(min<int>(ch, buffer.getChannels() - 1)).getData();
+            for (size_t i = 0; i < count; i++) {
+                dst[i * channels + ch] = in[i];
+            }
+        }
+        release(dst, count * channels * sizeof(float));
+        position += count;
+        return count;
+    }
+    size_t getFrames() const {
+        return frames;
+    }
+    size_t getRemaining() const {
+        return frames - position;
+    }
+    uint16_t getChannels() const {
+        return channels;
+    }
+    uint32_t getSampleRate() const {
+        return sample_rate;
+    }
+
+private:
+    static constexpr size_t header_size = 44;
+    int fd;
+    uint8_t* map;
+    size_t map_size;
+    uint8_t* data;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint16_t bits;
+    bool is_float;
+    size_t frames;
+    size_t position;
+
+    static uint32_t get32(const uint8_t* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+    static uint16_t get16(const uint8_t* p) {
+        return p[0] | (p[1] << 8);
+    }
+    static void put32(uint8_t* p, uint32_t v) {
+        p[0] = v;
+        p[1] = v >> 8;
+        p[2] = v >> 16;
+        p[3] = v >> 24;
+    }
+    static void put16(uint8_t* p, uint16_t v) {
+        p[0] = v;
+        p[1] = v >> 8;
+    }
+    bool parseHeader() {
+        if (memcmp(map, "RIFF", 4) || memcmp(map + 8, "WAVE", 4))
+            return false;
+        size_t offset = 12;
+        bool have_format = false;
+        while (offset + 8 <= map_size) {
+            const uint8_t* chunk = map + offset;
+            size_t chunk_size = get32(chunk + 4);
+            if (!memcmp(chunk, "fmt ", 4)) {
+                uint16_t format = get16(chunk + 8);
+                channels = get16(chunk + 10);
+                sample_rate = get32(chunk + 12);
+                bits = get16(chunk + 22);
+                if (format == 0xfffe && chunk_size >= 40)
+                    format = get16(chunk + 32); // WAVE_FORMAT_EXTENSIBLE subformat
+                is_float = format == 3;
+                have_format = (format == 1 && (bits == 16 || bits == 24)) ||
+                    (is_float && bits == 32);
+            }
+            else if (!memcmp(chunk, "data", 4)) {
+                if (!have_format || channels == 0)
+                    return false;
+                data = map + offset + 8;
+                chunk_size = min(chunk_size, map_size - offset - 8);
+                frames = chunk_size / (channels * bits / 8);
+                position = 0;
+                return true;
+            }
+            offset += 8 + chunk_size + (chunk_size & 1);
+        }
+        return false;
+    }
+    void writeHeader(size_t data_size) {
+        memcpy(map, "RIFF", 4);
+        put32(map + 4, header_size - 8 + data_size);
+        memcpy(map + 8, "WAVEfmt ", 8);
+        put32(map + 16, 16);
+        put16(map + 20, 3); // IEEE float
+        put16(map + 22, channels);
+        put32(map + 24, sample_rate);
+        put32(map + 28, sample_rate * channels * sizeof(float));
+        put16(map + 32, channels * sizeof(float));
+        put16(map + 34, 32);
+        memcpy(map + 36, "data", 4);
+        put32(map + 40, data_size);
+    }
+    float decode(const uint8_t* p) const {
+        if (is_float) {
+            float value;
+            memcpy(&value, p, sizeof(float));
+            return value;
+        }
+        else if (bits == 16) {
+            return (int16_t)get16(p) / 32768.0f;
+        }
+        else {
+            int32_t value = (p[0] << 8) | (p[1] << 16) | ((uint32_t)p[2] << 24);
+            return (value >> 8) / 8388608.0f;
+        }
+    }
+    /**
+     * Unmap pages that are fully consumed. The mapping is shared, so written
+     * pages stay in the page cache until the kernel writes them back; they
+     * just stop counting towards our resident set.
+     */
+    void release(const void* start, size_t length) {
+        static const uintptr_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t begin = (uintptr_t)start & ~(page - 1);
+        uintptr_t end = ((uintptr_t)start + length) & ~(page - 1);
+        if (end > begin)
+            madvise((void*)begin, end - begin, MADV_DONTNEED);
+    }
+};
+
+#endif
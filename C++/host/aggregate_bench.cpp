@@ -0,0 +1,165 @@
+/**
+ * Throughput of the reverb/saturator section against the latency added by
+ * BlockAggregator.
+ *
+ * For each host block size the effects run with every aggregation factor.
+ * Like in the patch, all parameter setters are called once per internal
+ * block, so per-call overhead is included. Reports ns/sample, speedup over
+ * a factor of 1 and the added latency. Each figure is the fastest of several
+ * runs, see benchmark().
+ *
+ * Usage: aggregate_bench [-o table.csv] [-r sample_rate]
+ **/
+
+#include "OpenWareLibrary.h"
+#include "DattorroStereoReverb.hpp"
+#include "SaturatorBank.hpp"
+#include "BlockAggregator.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static constexpr size_t BENCH_SAMPLES = 1 << 16; // Per run
+static constexpr size_t BENCH_RUNS = 64;
+static constexpr size_t NOISE_SAMPLES = 1 << 14; // Input table, repeated
+
+/**
+ * Effects section at one aggregation factor
+ */
+class EffectsBench {
+public:
+    EffectsBench(BlockAggregator* aggregator, DattorroStereoReverb<>* reverb,
+        SaturatorBank* saturator, AudioBuffer* buffer, const std::vector<float>& noise)
+        : aggregator(aggregator)
+        , reverb(reverb)
+        , saturator(saturator)
+        , buffer(buffer)
+        , noise(noise) {
+        reverb->setModulation(4460, 40, 6261, 50);
+    }
+    /**
+     * Time one run of BENCH_SAMPLES samples as a whole
+     * @return ns/sample
+     */
+    double run() {
+        auto effects = [this](AudioBuffer& block) {
+            reverb->setAmount(0.75);
+            reverb->setDecay(0.35 + 0.75 * 0.63);
+            reverb->setDiffusion(0.7);
+            reverb->setDamping(0.7);
+            reverb->process(block, block);
+            saturator->setCurve(size_t(3));
+            saturator->process(block, block);
+        };
+        size_t host_block_size = buffer->getSize();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < BENCH_SAMPLES; n += host_block_size) {
+            size_t offset = n % NOISE_SAMPLES;
+            for (size_t ch = 0; ch < 2; ch++) {
+                const float* input = &noise[ch * NOISE_SAMPLES + offset];
+                std::copy(input, input + host_block_size,
+                    buffer->getSamples(ch).getData());
+            }
+            aggregator->process(*buffer, effects);
+        }
+        std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - start;
+        return elapsed.count() / BENCH_SAMPLES;
+    }
+    static EffectsBench* create(size_t host_block_size, size_t factor,
+        float sample_rate, const std::vector<float>& noise) {
+        BlockAggregator* aggregator = BlockAggregator::create(host_block_size, factor);
+        size_t block_size = aggregator->getInternalBlockSize();
+        return new EffectsBench(aggregator,
+            DattorroStereoReverb<>::create(block_size, sample_rate, rings_delays),
+            SaturatorBank::create(block_size), AudioBuffer::create(2, host_block_size),
+            noise);
+    }
+    static void destroy(EffectsBench* bench) {
+        AudioBuffer::destroy(bench->buffer);
+        SaturatorBank::destroy(bench->saturator);
+        DattorroStereoReverb<>::destroy(bench->reverb);
+        BlockAggregator::destroy(bench->aggregator);
+        delete bench;
+    }
+
+private:
+    BlockAggregator* aggregator;
+    DattorroStereoReverb<>* reverb;
+    SaturatorBank* saturator;
+    AudioBuffer* buffer;
+    const std::vector<float>& noise;
+};
+
+/**
+ * Fastest of BENCH_RUNS runs for every bench after a warmup run. Benches
+ * take turns within each run, so that a slow stretch of the machine hits
+ * all of them rather than a few.
+ */
+static std::vector<double> benchmark(const std::vector<EffectsBench*>& benches) {
+    std::vector<double> ns(benches.size(), HUGE_VAL);
+    for (size_t run = 0; run <= BENCH_RUNS; run++) { // Run 0 is the warmup
+        for (size_t b = 0; b < benches.size(); b++) {
+            double run_ns = benches[b]->run();
+            if (run > 0)
+                ns[b] = std::min(ns[b], run_ns);
+        }
+    }
+    return ns;
+}
+
+int main(int argc, char** argv) {
+    FILE* out = stdout;
+    float sample_rate = 48000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            out = fopen(argv[++i], "w");
+            if (out == nullptr) {
+                fprintf(stderr, "Can't open %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            sample_rate = atof(argv[++i]);
+        }
+        else {
+            fprintf(stderr, "Usage: %s [-o table.csv] [-r sample_rate]\n", argv[0]);
+            return 2;
+        }
+    }
+    std::vector<size_t> host_block_sizes = {4, 8, 16, 32, 64};
+    std::vector<size_t> factors = {1, 2, 4, 8, 16};
+    std::vector<float> noise(NOISE_SAMPLES * 2);
+    uint32_t seed = 1;
+    for (float& sample : noise) {
+        seed = seed * 1664525 + 1013904223;
+        sample = (seed >> 8) / float(1 << 24) - 0.5f;
+    }
+
+    fprintf(out, "host_block,factor,internal_block,latency_samples,latency_ms,"
+                 "ns_per_sample,speedup\n");
+    std::vector<EffectsBench*> benches;
+    for (size_t host_block_size : host_block_sizes) {
+        for (size_t factor : factors) {
+            benches.push_back(
+                EffectsBench::create(host_block_size, factor, sample_rate, noise));
+        }
+    }
+    std::vector<double> ns = benchmark(benches);
+    for (size_t b = 0; b < benches.size(); b++) {
+        size_t host_block_size = host_block_sizes[b / factors.size()];
+        size_t factor = factors[b % factors.size()];
+        size_t latency = (factor - 1) * host_block_size;
+        double baseline = ns[b - b % factors.size()];
+        fprintf(out, "%zu,%zu,%zu,%zu,%.2f,%.2f,%.2f\n", host_block_size, factor,
+            host_block_size * factor, latency, latency * 1000 / sample_rate, ns[b],
+            baseline / ns[b]);
+        EffectsBench::destroy(benches[b]);
+    }
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
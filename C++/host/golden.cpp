@@ -0,0 +1,371 @@
+/**
+ * Golden output regression check.
+ *
+ * "record" renders every reference case with the scalar code and stores the
+ * result as float WAV files. "check" renders every variant of each case,
+ * the scalar code itself included, and compares it to the stored reference
+ * against that variant's error budget:
+ *   - max abs: largest sample difference
+ *   - spectral: energy of the difference between Hann windowed magnitude
+ *     spectra, relative to the reference, in dB. This ignores phase, so
+ *     variants with a slightly different LFO or latency-free but reordered
+ *     arithmetic can be held to a tight budget on what is audible.
+ *
+ * Inputs are generated from a fixed seed, so renders are deterministic.
+ * References must be recorded before a change to the numerics and checked
+ * after it; the exit status is non-zero when a budget is exceeded. They are
+ * not committed (about 750 kB per case), record them from the commit the
+ * change is based on:
+ *
+ *   git worktree add /tmp/baseline <commit>
+ *   (build golden in /tmp/baseline) && golden record refs
+ *   (build golden in the working tree) && golden check refs
+ *
+ * Usage: golden record <dir>
+ *        golden check <dir>
+ *
+ * FrippertronicsPatch itself needs the device runtime, its signal chain is
+ * covered by the "chain" case, which renders it through RenderChain.
+ **/
+
+#include "WavFile.hpp"
+#include "Spectrum.hpp"
+#include "RenderChain.hpp"
+#include "BatchedDattorroReverb.hpp"
+#include "SaturatorBank.hpp"
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+static constexpr float SAMPLE_RATE = 48000;
+static constexpr size_t BLOCK_SIZE = 64;
+static constexpr size_t LENGTH = 2 * 48000;
+static constexpr size_t SPECTRUM_SIZE = 2048;
+
+using Renderer = std::function<void(AudioBuffer&)>;
+using RendererFactory = std::function<Renderer()>;
+
+struct Variant {
+    const char* name;
+    RendererFactory factory;
+    float max_abs; // Budget for largest sample difference
+    float spectral_db; // Budget for spectral error
+};
+
+struct GoldenCase {
+    std::string name;
+    float drive; // Input gain
+    std::vector<Variant> variants; // The first one renders the reference
+    size_t input = 0; // Input variation, see generateInput()
+};
+
+template <typename T, typename... Args>
+static std::shared_ptr<T> make(Args&&... args) {
+    return std::shared_ptr<T>(T::create(std::forward<Args>(args)...), T::destroy);
+}
+
+/**
+ * Sine sweep with noise bursts, different on each channel. The last quarter
+ * is silent so that reverb tails are compared too. Each variation has its
+ * own noise and a sweep shifted up by a whole tone.
+ */
+static void generateInput(AudioBuffer& buffer, float drive, size_t variation) {
+    uint32_t seed = 0x12345678 + variation * 0x9e3779b9;
+    double shift = pow(2.0, variation / 6.0);
+    for (size_t ch = 0; ch < 2; ch++) {
+        float* samples = buffer.getSamples(ch).getData();
+        double phase = 0;
+        for (size_t i = 0; i < LENGTH; i++) {
+            if (i >= LENGTH * 3 / 4) {
+                samples[i] = 0;
+                continue;
+            }
+            double t = double(i) / LENGTH;
+            double frequency = 40 * pow(200.0, t) * (ch ? 1.5 : 1.0) * shift;
+            phase += 2 * M_PI * frequency / SAMPLE_RATE;
+            seed = seed * 1664525 + 1013904223;
+            float noise = (seed >> 8) / float(1 << 24) - 0.5f;
+            bool burst = (i / 4800) % 5 == ch + 1;
+            samples[i] = drive * (0.5f * sin(phase) + (burst ? noise : 0));
+        }
+    }
+}
+
+static AudioBuffer* render(const RendererFactory& factory, float drive,
+    size_t variation) {
+    AudioBuffer* buffer = AudioBuffer::create(2, LENGTH);
+    generateInput(*buffer, drive, variation);
+    AudioBuffer* block = AudioBuffer::create(2, BLOCK_SIZE);
+    Renderer renderer = factory();
+    for (size_t offset = 0; offset + BLOCK_SIZE <= LENGTH; offset += BLOCK_SIZE) {
+        for (size_t ch = 0; ch < 2; ch++) {
+            block->getSamples(ch).copyFrom(
+                buffer->getSamples(ch).subArray(offset, BLOCK_SIZE));
+        }
+        renderer(*block);
+        for (size_t ch = 0; ch < 2; ch++) {
+            buffer->getSamples(ch).subArray(offset, BLOCK_SIZE).copyFrom(
+                block->getSamples(ch));
+        }
+    }
+    AudioBuffer::destroy(block);
+    return buffer;
+}
+
+struct ReverbLane {
+    float amount;
+    float diffusion;
+    float damping;
+    float modulation[2]; // LFO amounts
+    float max_abs; // Budgets for the batched reverb
+    float spectral_db;
+};
+
+/**
+ * Settings for every lane of the batched reverb, lane n renders input
+ * variation n through them. Lane 0 is the patch default. The batched LFOs
+ * drift slightly from the scalar ones, so the error grows with modulation
+ * and decay; lane 3 is unmodulated and must match exactly. Budgets are
+ * about 25% above the measured error.
+ */
+static const ReverbLane reverb_lanes[] = {
+    {0.6, 0.7, 0.6, {40, 50}, 0.0058, -61},
+    {0.2, 0.5, 0.1, {20, 70}, 1.1e-4, -93},
+    {0.9, 0.6, 0.8, {60, 30}, 0.024, -52},
+    {0.4, 0.8, 0.3, {0, 0}, 0, -200},
+    {0.7, 0.4, 0.5, {80, 40}, 0.011, -60},
+    {0.5, 0.9, 0.9, {10, 10}, 0.0026, -62},
+    {0.8, 0.3, 0.2, {50, 90}, 0.0055, -70},
+    {0.3, 0.6, 0.7, {30, 20}, 0.0017, -69},
+};
+
+template <typename Reverb, typename... Lane>
+static void setupReverb(Reverb* reverb, const ReverbLane& settings, Lane... lane) {
+    reverb->setModulation(lane..., 4460, settings.modulation[0], 6261,
+        settings.modulation[1]);
+    reverb->setAmount(lane..., settings.amount);
+    reverb->setDecay(lane..., 0.35 + settings.amount * 0.63);
+    reverb->setDiffusion(lane..., settings.diffusion);
+    reverb->setDamping(lane..., settings.damping);
+}
+
+template <bool with_smear>
+static Renderer scalarReverb(size_t lane) {
+    auto reverb = make<DattorroStereoReverb<with_smear>>(BLOCK_SIZE, SAMPLE_RATE,
+        rings_delays);
+    setupReverb(reverb.get(), reverb_lanes[lane]);
+    return [reverb](AudioBuffer& buffer) { reverb->process(buffer, buffer); };
+}
+
+/**
+ * Every lane renders its own input with its own settings, only the compared
+ * lane's input comes from the block
+ */
+template <size_t lanes>
+static Renderer batchedReverb(size_t compared) {
+    auto reverb = make<BatchedDattorroReverb<lanes>>(BLOCK_SIZE, SAMPLE_RATE,
+        rings_delays);
+    auto inputs = std::shared_ptr<AudioBuffer>(
+        AudioBuffer::create(lanes * 2, LENGTH), AudioBuffer::destroy);
+    AudioBuffer* input = AudioBuffer::create(2, LENGTH);
+    for (size_t lane = 0; lane < lanes; lane++) {
+        setupReverb(reverb.get(), reverb_lanes[lane], lane);
+        generateInput(*input, 1, lane);
+        for (size_t ch = 0; ch < 2; ch++) {
+            inputs->getSamples(lane * 2 + ch).copyFrom(input->getSamples(ch));
+        }
+    }
+    AudioBuffer::destroy(input);
+    auto lanes_buffer = std::shared_ptr<AudioBuffer>(
+        AudioBuffer::create(lanes * 2, BLOCK_SIZE), AudioBuffer::destroy);
+    auto offset = std::make_shared<size_t>(0);
+    return [reverb, inputs, lanes_buffer, offset, compared](AudioBuffer& buffer) {
+        for (size_t ch = 0; ch < lanes * 2; ch++) {
+            lanes_buffer->getSamples(ch).copyFrom(ch / 2 == compared ?
+                    buffer.getSamples(ch & 1) :
+                    inputs->getSamples(ch).subArray(*offset, BLOCK_SIZE));
+        }
+        reverb->process(*lanes_buffer, *lanes_buffer);
+        for (size_t ch = 0; ch < 2; ch++) {
+            buffer.getSamples(ch).copyFrom(lanes_buffer->getSamples(compared * 2 + ch));
+        }
+        *offset += BLOCK_SIZE;
+    };
+}
+
+static Renderer chain(size_t freeze_length, RenderReverb reverb = RENDER_DATTORRO,
+    bool modulate = true) {
+    RenderSettings settings;
+    settings.freeze_length = freeze_length;
+    settings.reverb = reverb;
+    settings.modulate = modulate;
+    auto render_chain = std::shared_ptr<RenderChain>(
+        RenderChain::create(BLOCK_SIZE, SAMPLE_RATE, settings), RenderChain::destroy);
+    return [render_chain](AudioBuffer& buffer) { render_chain->process(buffer); };
+}
+
+template <typename Shaper>
+static Renderer monoShaper() {
+    auto left = make<Shaper>();
+    auto right = make<Shaper>();
+    return [left, right](AudioBuffer& buffer) {
+        FloatArray l = buffer.getSamples(0);
+        FloatArray r = buffer.getSamples(1);
+        left->process(l, l);
+        right->process(r, r);
+    };
+}
+
+static Renderer bankShaper(SaturatorCurve curve, bool antialiased) {
+    auto bank = make<SaturatorBank>(BLOCK_SIZE);
+    bank->setCurve(curve, antialiased);
+    bank->reset();
+    return [bank](AudioBuffer& buffer) { bank->process(buffer, buffer); };
+}
+
+#define SHAPER_CASES(name, curve)                                              \
+    cases.push_back({"aliasing_" #name, 3,                                     \
+        {{"scalar", monoShaper<Aliasing##name>, 0, -200},                      \
+            {"bank", [] { return bankShaper(curve, false); }, 0, -200}}});     \
+    cases.push_back({"antialiased_" #name, 3,                                  \
+        {{"scalar", monoShaper<Antialiased##name>, 0, -200},                   \
+            {"bank", [] { return bankShaper(curve, true); }, 1e-5, -100}}});
+
+static std::vector<GoldenCase> getCases() {
+    std::vector<GoldenCase> cases;
+    // Every lane of the batched reverb against a scalar render of that lane
+    for (size_t lane = 0; lane < 8; lane++) {
+        const ReverbLane& settings = reverb_lanes[lane];
+        std::vector<Variant> variants = {
+            {"scalar", [lane] { return scalarReverb<false>(lane); }, 0, -200}};
+        if (lane < 4) {
+            variants.push_back({"batched4", [lane] { return batchedReverb<4>(lane); },
+                settings.max_abs, settings.spectral_db});
+        }
+        variants.push_back({"batched8", [lane] { return batchedReverb<8>(lane); },
+            settings.max_abs, settings.spectral_db});
+        cases.push_back({"reverb_lane" + std::to_string(lane), 1, variants, lane});
+    }
+    cases.push_back({"reverb_smear", 1,
+        {{"scalar", [] { return scalarReverb<true>(0); }, 0, -200}}});
+    // Freezing takes a time invariant snapshot of a modulated tank, so its
+    // budget only catches a broken fast path, not LFO differences
+    cases.push_back({"chain", 1,
+        {{"scalar", [] { return chain(0); }, 0, -200},
+            {"frozen", [] { return chain(131072); }, 0.5, -15}}});
+    // Without LFOs the tank is time invariant and the impulse response is
+    // longer than the render, so only rounding separates the two
+    cases.push_back({"chain_static", 1,
+        {{"scalar", [] { return chain(0, RENDER_DATTORRO, false); }, 0, -200},
+            {"frozen", [] { return chain(131072, RENDER_DATTORRO, false); }, 1e-5,
+                -120}}});
+    cases.push_back({"chain_fdn4", 1,
+        {{"scalar", [] { return chain(0, RENDER_FDN4); }, 0, -200}}});
+    cases.push_back({"chain_fdn8", 1,
+        {{"scalar", [] { return chain(0, RENDER_FDN8); }, 0, -200}}});
+    SHAPER_CASES(HardClipper, CURVE_HARD_CLIP)
+    SHAPER_CASES(CubicSaturator, CURVE_CUBIC)
+    SHAPER_CASES(SecondOrderPolynomial, CURVE_SECOND_ORDER)
+    SHAPER_CASES(ThirdOrderPolynomial, CURVE_THIRD_ORDER)
+    SHAPER_CASES(FourthOrderPolynomial, CURVE_FOURTH_ORDER)
+    SHAPER_CASES(AlgebraicSaturator, CURVE_ALGEBRAIC)
+    SHAPER_CASES(TanhSaturator, CURVE_TANH)
+    SHAPER_CASES(ArctanSaturator, CURVE_ARCTAN)
+    SHAPER_CASES(SineSaturator, CURVE_SINE)
+    SHAPER_CASES(QuadraticSineSaturator, CURVE_QUADRATIC_SINE)
+    SHAPER_CASES(CubicSineSaturator, CURVE_CUBIC_SINE)
+    SHAPER_CASES(ReciprocalSaturator, CURVE_RECIPROCAL)
+    return cases;
+}
+
+static float maxAbsError(AudioBuffer& reference, AudioBuffer& output) {
+    float error = 0;
+    for (size_t ch = 0; ch < 2; ch++) {
+        const float* a = reference.getSamples(ch).getData();
+        const float* b = output.getSamples(ch).getData();
+        for (size_t i = 0; i < LENGTH; i++) {
+            error = max(error, fabsf(a[i] - b[i]));
+        }
+    }
+    return error;
+}
+
+static float spectralError(AudioBuffer& reference, AudioBuffer& output) {
+    double error = 0, total = 0;
+    for (size_t ch = 0; ch < 2; ch++) {
+        const float* a = reference.getSamples(ch).getData();
+        const float* b = output.getSamples(ch).getData();
+        for (size_t i = 0; i + SPECTRUM_SIZE <= LENGTH; i += SPECTRUM_SIZE / 2) {
+            std::vector<double> x = magnitudeSpectrum(a + i, SPECTRUM_SIZE);
+            std::vector<double> y = magnitudeSpectrum(b + i, SPECTRUM_SIZE);
+            for (size_t k = 0; k < x.size(); k++) {
+                error += (x[k] - y[k]) * (x[k] - y[k]);
+                total += x[k] * x[k];
+            }
+        }
+    }
+    if (error <= 0)
+        return -300;
+    return 10 * log10(error / max(total, 1e-30));
+}
+
+static bool record(const std::string& dir, const GoldenCase& golden) {
+    std::string path = dir + "/" + golden.name + ".wav";
+    AudioBuffer* output = render(golden.variants[0].factory, golden.drive, golden.input);
+    MappedWavFile file;
+    bool ok = file.openWrite(path.c_str(), 2, SAMPLE_RATE, LENGTH);
+    if (ok)
+        ok = file.write(*output, LENGTH) == LENGTH;
+    AudioBuffer::destroy(output);
+    if (!ok)
+        fprintf(stderr, "%s: can't write reference\n", path.c_str());
+    return ok;
+}
+
+static bool check(const std::string& dir, const GoldenCase& golden) {
+    std::string path = dir + "/" + golden.name + ".wav";
+    MappedWavFile file;
+    if (!file.openRead(path.c_str()) || file.getFrames() != LENGTH ||
+        file.getChannels() != 2) {
+        fprintf(stderr, "%s: missing or invalid reference\n", path.c_str());
+        return false;
+    }
+    AudioBuffer* reference = AudioBuffer::create(2, LENGTH);
+    file.read(*reference);
+    bool passed = true;
+    for (const Variant& variant : golden.variants) {
+        AudioBuffer* output = render(variant.factory, golden.drive, golden.input);
+        float max_abs = maxAbsError(*reference, *output);
+        float spectral_db = spectralError(*reference, *output);
+        bool ok = max_abs <= variant.max_abs && spectral_db <= variant.spectral_db;
+        printf("%-4s %-32s %-11s max abs %.3g (%.3g), spectral %.1f dB (%.1f)\n",
+            ok ? "ok" : "FAIL", golden.name.c_str(), variant.name, max_abs,
+            variant.max_abs, spectral_db, variant.spectral_db);
+        passed &= ok;
+        AudioBuffer::destroy(output);
+    }
+    AudioBuffer::destroy(reference);
+    return passed;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3 || (strcmp(argv[1], "record") && strcmp(argv[1], "check"))) {
+        fprintf(stderr, "Usage: %s record|check <dir>\n", argv[0]);
+        return 2;
+    }
+    bool recording = !strcmp(argv[1], "record");
+    size_t failed = 0;
+    std::vector<GoldenCase> cases = getCases();
+    for (const GoldenCase& golden : cases) {
+        if (!(recording ? record(argv[2], golden) : check(argv[2], golden)))
+            failed++;
+    }
+    if (recording)
+        printf("Recorded %zu of %zu references\n", cases.size() - failed, cases.size());
+    else
+        printf("%zu of %zu cases passed\n", cases.size() - failed, cases.size());
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,245 @@
+/**
+ * Offline batch renderer.
+ *
+ * Runs one RenderChain per input file on a work-stealing thread pool, or
+ * with --batch one BatchedRenderChain per group of files. Audio is streamed
+ * through memory-mapped WAV files in fixed-size chunks, so memory use per
+ * job is a couple of blocks regardless of file length.
+ *
+ * Usage: render [options] -o <dir> <file.wav>...
+ *   -j <threads>    worker threads (default: hardware concurrency)
+ *   -b <frames>     chunk size (default: 256)
+ *   -t <seconds>    reverb tail appended to each file (default: 5)
+ *   --gain <x> --amount <x> --diffusion <x> --damping <x>
+ *   --no-saturation
+ *   --reverb <name>      dattorro (default), fdn4 or fdn8
+ *   --freeze <samples>   render through the convolution fast path with an
+ *                        impulse response of this length
+ *   --batch <lanes>      render 4 or 8 files at a time through the batched
+ *                        Dattorro reverb, for throughput on many files
+ *
+ * Files are independent tasks; a single file is not split into segments
+ * because the reverb tank carries state across the whole render.
+ **/
+
+#include "WavFile.hpp"
+#include "ThreadPool.hpp"
+#include "RenderChain.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+struct RenderJob {
+    std::string input;
+    std::string output;
+};
+
+/**
+ * Reverb tails decay into denormals, which are many times slower on x86 and
+ * stall every lane of a batch. The mode is per thread, so each job sets it.
+ */
+static void flushDenormals() {
+#ifdef __SSE__
+    _mm_setcsr(_mm_getcsr() | 0x8040); // Flush to zero, denormals are zero
+#endif
+}
+
+static bool render(const RenderJob& job, const RenderSettings& settings,
+    size_t block_size, float tail) {
+    MappedWavFile in;
+    if (!in.openRead(job.input.c_str())) {
+        fprintf(stderr, "%s: unsupported or unreadable WAV file\n", job.input.c_str());
+        return false;
+    }
+    float sr = in.getSampleRate();
+    size_t total = in.getFrames() + size_t(tail * sr);
+    MappedWavFile out;
+    if (!out.openWrite(job.output.c_str(), 2, in.getSampleRate(), total)) {
+        fprintf(stderr, "%s: can't create output file\n", job.output.c_str());
+        return false;
+    }
+    AudioBuffer* buffer = AudioBuffer::create(2, block_size);
+    RenderChain* chain = RenderChain::create(block_size, sr, settings);
+    while (out.getRemaining() > 0) {
+        // Past the end of input, read() returns silence and the tail rings out
+        in.read(*buffer);
+        chain->process(*buffer);
+        out.write(*buffer, block_size);
+    }
+    RenderChain::destroy(chain);
+    AudioBuffer::destroy(buffer);
+    return true;
+}
+
+/**
+ * Render up to lanes jobs together. Files with another sample rate than the
+ * first one can't share the reverb and are rendered on their own.
+ * @return number of failed jobs
+ */
+template <size_t lanes>
+static size_t renderBatch(const RenderJob* jobs, size_t count,
+    const RenderSettings& settings, size_t block_size, float tail) {
+    MappedWavFile in[lanes];
+    MappedWavFile out[lanes];
+    AudioBuffer* buffers[lanes];
+    bool active[lanes] = {};
+    size_t failed = 0;
+    float sr = 0;
+    for (size_t lane = 0; lane < lanes; lane++) {
+        buffers[lane] = AudioBuffer::create(2, block_size);
+        buffers[lane]->clear();
+        if (lane >= count)
+            continue;
+        const RenderJob& job = jobs[lane];
+        if (!in[lane].openRead(job.input.c_str())) {
+            fprintf(stderr, "%s: unsupported or unreadable WAV file\n", job.input.c_str());
+            failed++;
+            continue;
+        }
+        if (sr == 0)
+            sr = in[lane].getSampleRate();
+        if (in[lane].getSampleRate() != sr) {
+            in[lane].close();
+            failed += !render(job, settings, block_size, tail);
+            continue;
+        }
+        size_t total = in[lane].getFrames() + size_t(tail * sr);
+        if (!out[lane].openWrite(job.output.c_str(), 2, sr, total)) {
+            fprintf(stderr, "%s: can't create output file\n", job.output.c_str());
+            failed++;
+            continue;
+        }
+        active[lane] = true;
+    }
+    if (sr > 0) {
+        auto chain = BatchedRenderChain<lanes>::create(block_size, sr, settings);
+        for (bool pending = true; pending;) {
+            pending = false;
+            for (size_t lane = 0; lane < lanes; lane++) {
+                if (active[lane])
+                    in[lane].read(*buffers[lane]);
+            }
+            chain->process(buffers);
+            for (size_t lane = 0; lane < lanes; lane++) {
+                if (active[lane]) {
+                    out[lane].write(*buffers[lane], block_size);
+                    pending |= out[lane].getRemaining() > 0;
+                }
+            }
+        }
+        BatchedRenderChain<lanes>::destroy(chain);
+    }
+    for (size_t lane = 0; lane < lanes; lane++) {
+        AudioBuffer::destroy(buffers[lane]);
+    }
+    return failed;
+}
+
+static std::string basename(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+int main(int argc, char** argv) {
+    RenderSettings settings;
+    size_t threads = std::thread::hardware_concurrency();
+    size_t block_size = 256;
+    float tail = 5;
+    size_t batch = 0;
+    std::string output_dir;
+    std::vector<std::string> inputs;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-j" && has_value)
+            threads = atoi(argv[++i]);
+        else if (arg == "-b" && has_value)
+            block_size = atoi(argv[++i]);
+        else if (arg == "-t" && has_value)
+            tail = atof(argv[++i]);
+        else if (arg == "-o" && has_value)
+            output_dir = argv[++i];
+        else if (arg == "--gain" && has_value)
+            settings.gain = atof(argv[++i]);
+        else if (arg == "--amount" && has_value)
+            settings.amount = atof(argv[++i]);
+        else if (arg == "--diffusion" && has_value)
+            settings.diffusion = atof(argv[++i]);
+        else if (arg == "--damping" && has_value)
+            settings.damping = atof(argv[++i]);
+        else if (arg == "--freeze" && has_value)
+            settings.freeze_length = atoi(argv[++i]);
+        else if (arg == "--batch" && has_value)
+            batch = atoi(argv[++i]);
+        else if (arg == "--no-saturation")
+            settings.saturate = false;
+        else if (arg == "--reverb" && has_value) {
+            std::string name = argv[++i];
+            if (name == "dattorro")
+                settings.reverb = RENDER_DATTORRO;
+            else if (name == "fdn4")
+                settings.reverb = RENDER_FDN4;
+            else if (name == "fdn8")
+                settings.reverb = RENDER_FDN8;
+            else {
+                fprintf(stderr, "Unknown reverb %s\n", name.c_str());
+                return 2;
+            }
+        }
+        else if (arg[0] == '-') {
+            fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return 2;
+        }
+        else
+            inputs.push_back(arg);
+    }
+    if (settings.freeze_length > 0 && (block_size & (block_size - 1))) {
+        fprintf(stderr, "Freeze mode needs a power of two block size\n");
+        return 2;
+    }
+    if (batch != 0 && batch != 4 && batch != 8) {
+        fprintf(stderr, "Batches have 4 or 8 lanes\n");
+        return 2;
+    }
+    if (batch != 0 && (settings.reverb != RENDER_DATTORRO || settings.freeze_length > 0)) {
+        fprintf(stderr, "Batches only render the Dattorro reverb, without freeze\n");
+        return 2;
+    }
+    if (output_dir.empty() || inputs.empty() || block_size == 0) {
+        fprintf(stderr, "Usage: %s [-j threads] [-b frames] [-t seconds] "
+                        "-o <dir> <file.wav>...\n", argv[0]);
+        return 2;
+    }
+
+    std::atomic<size_t> failed(0);
+    {
+        std::vector<RenderJob> jobs;
+        for (auto& input : inputs) {
+            jobs.push_back({input, output_dir + "/" + basename(input)});
+        }
+        ThreadPool pool(threads);
+        size_t group = max<size_t>(batch, 1);
+        for (size_t first = 0; first < jobs.size(); first += group) {
+            const RenderJob* group_jobs = &jobs[first];
+            size_t count = min(group, jobs.size() - first);
+            pool.submit([group_jobs, count, batch, &settings, block_size, tail, &failed] {
+                flushDenormals();
+                if (batch == 4)
+                    failed += renderBatch<4>(group_jobs, count, settings, block_size, tail);
+                else if (batch == 8)
+                    failed += renderBatch<8>(group_jobs, count, settings, block_size, tail);
+                else if (!render(*group_jobs, settings, block_size, tail))
+                    failed++;
+            });
+        }
+        pool.wait();
+    }
+    printf("Rendered %zu of %zu files\n", inputs.size() - failed, inputs.size());
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+/**
+ * Cost versus echo density for the Dattorro and FDN reverbs.
+ *
+ * For each reverb it reports processing cost in ns/sample on noise, and
+ * how fast its impulse response turns dense. Echo density is measured as
+ * the normalized echo density of Abel and Huang: the fraction of samples
+ * in a 20 ms window that lie more than one standard deviation from zero,
+ * divided by the fraction expected for Gaussian noise. It starts near 0
+ * for sparse early echoes and settles around 1 once the tail is diffuse.
+ * dense_ms is the time at which it first reaches DENSE_THRESHOLD.
+ *
+ * Usage: reverb_bench [-o table.csv] [-r sample_rate]
+ **/
+
+#include "OpenWareLibrary.h"
+#include "DattorroStereoReverb.hpp"
+#include "FdnReverb.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static constexpr size_t BLOCK_SIZE = 64;
+static constexpr size_t TIMING_SAMPLES = 1 << 20;
+static constexpr double DENSITY_WINDOW = 0.02; // In seconds
+static constexpr double DENSE_THRESHOLD = 0.9;
+static constexpr double IR_LENGTH = 0.5; // In seconds
+
+template <typename Reverb>
+static Reverb* createReverb(float sample_rate, const size_t* delay_lengths) {
+    Reverb* reverb = Reverb::create(BLOCK_SIZE, sample_rate, delay_lengths);
+    reverb->setModulation(4460, 40, 6261, 50);
+    reverb->setAmount(1); // Wet only
+    reverb->setDecay(0.35 + 0.75 * 0.63);
+    reverb->setDiffusion(0.7);
+    reverb->setDamping(0.7);
+    return reverb;
+}
+
+template <typename Reverb>
+static double measureCost(float sample_rate, const size_t* delay_lengths) {
+    Reverb* reverb = createReverb<Reverb>(sample_rate, delay_lengths);
+    AudioBuffer* buffer = AudioBuffer::create(2, BLOCK_SIZE);
+    uint32_t seed = 1;
+    double ns = 0;
+    for (size_t n = 0; n < TIMING_SAMPLES; n += BLOCK_SIZE) {
+        for (size_t ch = 0; ch < 2; ch++) {
+            float* samples = buffer->getSamples(ch).getData();
+            for (size_t i = 0; i < BLOCK_SIZE; i++) {
+                seed = seed * 1664525 + 1013904223;
+                samples[i] = (seed >> 8) / float(1 << 24) - 0.5f;
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        reverb->process(*buffer, *buffer);
+        ns += std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start)
+                  .count();
+    }
+    AudioBuffer::destroy(buffer);
+    Reverb::destroy(reverb);
+    return ns / TIMING_SAMPLES;
+}
+
+/**
+ * Left output for an impulse on the left input
+ */
+template <typename Reverb>
+static std::vector<float> impulseResponse(float sample_rate, const size_t* delay_lengths) {
+    Reverb* reverb = createReverb<Reverb>(sample_rate, delay_lengths);
+    AudioBuffer* buffer = AudioBuffer::create(2, BLOCK_SIZE);
+    size_t length = size_t(IR_LENGTH * sample_rate) / BLOCK_SIZE * BLOCK_SIZE;
+    std::vector<float> response;
+    for (size_t n = 0; n < length; n += BLOCK_SIZE) {
+        buffer->clear();
+        if (n == 0)
+            buffer->getSamples(0)[0] = 1;
+        reverb->process(*buffer, *buffer);
+        float* samples = buffer->getSamples(0).getData();
+        response.insert(response.end(), samples, samples + BLOCK_SIZE);
+    }
+    AudioBuffer::destroy(buffer);
+    Reverb::destroy(reverb);
+    return response;
+}
+
+/**
+ * @return time in ms at which the normalized echo density first reaches
+ * DENSE_THRESHOLD, or -1 if it never does
+ */
+static double measureDenseTime(const std::vector<float>& response, float sample_rate) {
+    const double gaussian = erfc(1 / sqrt(2.0));
+    size_t window = DENSITY_WINDOW * sample_rate;
+    for (size_t start = 0; start + window <= response.size(); start += window / 8) {
+        double energy = 0;
+        for (size_t i = start; i < start + window; i++) {
+            energy += response[i] * response[i];
+        }
+        double deviation = sqrt(energy / window);
+        if (deviation == 0)
+            continue;
+        size_t outside = 0;
+        for (size_t i = start; i < start + window; i++) {
+            outside += fabs(response[i]) > deviation;
+        }
+        if (outside / double(window) / gaussian >= DENSE_THRESHOLD)
+            return (start + window / 2) * 1000.0 / sample_rate;
+    }
+    return -1;
+}
+
+template <typename Reverb>
+static void benchmark(FILE* out, const char* name, float sample_rate,
+    const size_t* delay_lengths, double& baseline) {
+    double ns = measureCost<Reverb>(sample_rate, delay_lengths);
+    if (baseline == 0)
+        baseline = ns;
+    double dense_ms =
+        measureDenseTime(impulseResponse<Reverb>(sample_rate, delay_lengths), sample_rate);
+    fprintf(out, "%s,%.2f,%.2f,%.1f\n", name, ns, ns / baseline, dense_ms);
+}
+
+int main(int argc, char** argv) {
+    FILE* out = stdout;
+    float sample_rate = 48000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            out = fopen(argv[++i], "w");
+            if (out == nullptr) {
+                fprintf(stderr, "Can't open %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            sample_rate = atof(argv[++i]);
+        }
+        else {
+            fprintf(stderr, "Usage: %s [-o table.csv] [-r sample_rate]\n", argv[0]);
+            return 2;
+        }
+    }
+    double baseline = 0;
+    fprintf(out, "reverb,ns_per_sample,relative_cost,dense_ms\n");
+    benchmark<DattorroStereoReverb<>>(out, "dattorro", sample_rate, rings_delays, baseline);
+    benchmark<FdnReverb<4, FDN_HADAMARD>>(
+        out, "fdn4_hadamard", sample_rate, fdn4_delays, baseline);
+    benchmark<FdnReverb<4, FDN_HOUSEHOLDER>>(
+        out, "fdn4_householder", sample_rate, fdn4_delays, baseline);
+    benchmark<FdnReverb<8, FDN_HADAMARD>>(
+        out, "fdn8_hadamard", sample_rate, fdn8_delays, baseline);
+    benchmark<FdnReverb<8, FDN_HOUSEHOLDER>>(
+        out, "fdn8_householder", sample_rate, fdn8_delays, baseline);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,141 @@
+/**
+ * Cost versus aliasing matrix for every Nonlinearity curve.
+ *
+ * Each curve runs in both Aliasing* and Antialiased* form on sine inputs
+ * swept over frequency and drive. For every point it reports processing
+ * cost in ns/sample, the fastest of TIMING_RUNS runs after a warmup run,
+ * and the aliasing level: the sine is coherent with the FFT frame, so true
+ * harmonics land on exact bins, which are masked out.
+ * Whatever energy is left is aliasing, given in dB relative to the total.
+ *
+ * Usage: saturator_bench [-o table.csv] [-r sample_rate]
+ * The CSV goes to stdout by default, one row per curve/mode/freq/drive.
+ **/
+
+#include "OpenWareLibrary.h"
+#include "Nonlinearity.hpp"
+#include "Spectrum.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static constexpr size_t FFT_SIZE = 8192;
+static constexpr size_t BLOCK_SIZE = 64;
+static constexpr size_t TIMING_SAMPLES = 1 << 20;
+static constexpr size_t TIMING_RUNS = 7;
+
+/**
+ * @param bin fundamental, in FFT bins
+ * @return aliasing energy relative to total output energy, in dB
+ */
+static double measureAliasing(const std::vector<float>& output, size_t bin) {
+    std::vector<std::complex<double>> spectrum(output.begin(), output.end());
+    fft(spectrum);
+    double total = 0, aliasing = 0;
+    for (size_t k = 1; k < FFT_SIZE / 2; k++) {
+        double power = std::norm(spectrum[k]);
+        total += power;
+        if (k % bin != 0)
+            aliasing += power;
+    }
+    if (total <= 0)
+        return -300;
+    return 10 * log10(max(aliasing / total, 1e-30));
+}
+
+template <typename Shaper>
+static void benchmark(FILE* out, const char* curve, const char* mode,
+    float sample_rate, const std::vector<float>& frequencies,
+    const std::vector<float>& drives) {
+    for (float frequency : frequencies) {
+        // Odd bin count keeps harmonics from landing on the fundamental's
+        // own aliases
+        size_t bin = size_t(frequency * FFT_SIZE / sample_rate) | 1;
+        float actual = bin * sample_rate / FFT_SIZE;
+        for (float drive : drives) {
+            Shaper* shaper = Shaper::create();
+            std::vector<float> input(FFT_SIZE * 2);
+            std::vector<float> output(FFT_SIZE * 2);
+            for (size_t i = 0; i < input.size(); i++) {
+                // Phase reduced to one period and computed in double, or
+                // rounding of the argument adds a noise floor that isn't
+                // aliasing
+                input[i] = drive * sin(2 * M_PI * ((bin * i) % FFT_SIZE) / FFT_SIZE);
+            }
+            // First frame settles the ADAA state, second one is measured
+            for (size_t i = 0; i < input.size(); i += BLOCK_SIZE) {
+                shaper->process(FloatArray(&input[i], BLOCK_SIZE),
+                    FloatArray(&output[i], BLOCK_SIZE));
+            }
+            std::vector<float> frame(output.begin() + FFT_SIZE, output.end());
+            double alias_db = measureAliasing(frame, bin);
+
+            double ns = HUGE_VAL;
+            for (size_t run = 0; run <= TIMING_RUNS; run++) { // Run 0 is the warmup
+                auto start = std::chrono::steady_clock::now();
+                for (size_t n = 0; n < TIMING_SAMPLES; n += BLOCK_SIZE) {
+                    size_t offset = n % (input.size() - BLOCK_SIZE);
+                    shaper->process(FloatArray(&input[offset], BLOCK_SIZE),
+                        FloatArray(&output[offset], BLOCK_SIZE));
+                }
+                std::chrono::duration<double, std::nano> elapsed =
+                    std::chrono::steady_clock::now() - start;
+                if (run > 0)
+                    ns = std::min(ns, elapsed.count() / TIMING_SAMPLES);
+            }
+            fprintf(out, "%s,%s,%.1f,%.2f,%.3f,%.1f\n", curve, mode, actual, drive,
+                ns, alias_db);
+            Shaper::destroy(shaper);
+        }
+    }
+}
+
+#define BENCHMARK_CURVE(name)                                                  \
+    benchmark<Aliasing##name>(out, #name, "aliasing", sample_rate,              \
+        frequencies, drives);                                                   \
+    benchmark<Antialiased##name>(out, #name, "antialiased", sample_rate,        \
+        frequencies, drives);
+
+int main(int argc, char** argv) {
+    FILE* out = stdout;
+    float sample_rate = 48000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            out = fopen(argv[++i], "w");
+            if (out == nullptr) {
+                fprintf(stderr, "Can't open %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            sample_rate = atof(argv[++i]);
+        }
+        else {
+            fprintf(stderr, "Usage: %s [-o table.csv] [-r sample_rate]\n", argv[0]);
+            return 2;
+        }
+    }
+    std::vector<float> frequencies = {110, 440, 1760, 5000, 10000};
+    std::vector<float> drives = {0.5, 1, 2, 4, 8};
+
+    fprintf(out, "curve,mode,frequency,drive,ns_per_sample,aliasing_db\n");
+    BENCHMARK_CURVE(HardClipper)
+    BENCHMARK_CURVE(CubicSaturator)
+    BENCHMARK_CURVE(SecondOrderPolynomial)
+    BENCHMARK_CURVE(ThirdOrderPolynomial)
+    BENCHMARK_CURVE(FourthOrderPolynomial)
+    BENCHMARK_CURVE(AlgebraicSaturator)
+    BENCHMARK_CURVE(TanhSaturator)
+    BENCHMARK_CURVE(ArctanSaturator)
+    BENCHMARK_CURVE(SineSaturator)
+    BENCHMARK_CURVE(QuadraticSineSaturator)
+    BENCHMARK_CURVE(CubicSineSaturator)
+    BENCHMARK_CURVE(ReciprocalSaturator)
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}